@@ -0,0 +1,99 @@
+#include "bars.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+BarAggregator::BarAggregator(std::vector<std::uint64_t> intervals_ns)
+    : intervals_ns_(std::move(intervals_ns)) {}
+
+void BarAggregator::on_event(const databento::MboMsg& ev) {
+    if (!enabled()) return;
+
+    const std::uint32_t instrument = ev.hd.instrument_id;
+    const std::uint64_t ts = ev.hd.ts_event.time_since_epoch().count();
+    const bool is_trade = ev.action == databento::Action::Trade && ev.size > 0;
+
+    auto it = instruments_.find(instrument);
+    if (it == instruments_.end()) {
+        if (!is_trade) return;
+        it = instruments_.emplace(instrument, InstrumentState{}).first;
+        it->second.open.resize(intervals_ns_.size());
+    }
+    InstrumentState& state = it->second;
+
+    for (std::size_t i = 0; i < intervals_ns_.size(); ++i) {
+        Bar& bar = state.open[i];
+        const std::uint64_t interval = intervals_ns_[i];
+        const std::uint64_t bucket = ts - ts % interval;
+
+        if (bar.trades > 0 && bucket > bar.start_ns) {
+            closed_.push_back(bar);
+            bar.trades = 0;
+        }
+        if (!is_trade) continue;
+
+        if (bar.trades == 0) {
+            bar = Bar{instrument, interval, bucket, ev.price, ev.price, ev.price, ev.price, 0, 0, 0};
+        }
+        bar.high = std::max(bar.high, ev.price);
+        bar.low = std::min(bar.low, ev.price);
+        bar.close = ev.price;
+        bar.volume += ev.size;
+        bar.trades += 1;
+        bar.notional += static_cast<long double>(ev.price) * ev.size;
+    }
+
+    if (is_trade) {
+        state.last_trade = Trade{ts, ev.price, ev.size, static_cast<char>(ev.side)};
+    }
+}
+
+std::vector<Bar> BarAggregator::take_closed() {
+    std::vector<Bar> out;
+    out.swap(closed_);
+    return out;
+}
+
+void BarAggregator::flush() {
+    for (auto& [instrument, state] : instruments_) {
+        for (Bar& bar : state.open) {
+            if (bar.trades > 0) {
+                closed_.push_back(bar);
+                bar.trades = 0;
+            }
+        }
+    }
+}
+
+nlohmann::json BarAggregator::last_trades_json() const {
+    nlohmann::json j = nlohmann::json::array();
+    for (const auto& [instrument, state] : instruments_) {
+        j.push_back({
+            {"instrument_id", instrument},
+            {"ts", state.last_trade.ts_event},
+            {"price", state.last_trade.price},
+            {"size", state.last_trade.size},
+            {"side", std::string(1, state.last_trade.side)},
+        });
+    }
+    return j;
+}
+
+nlohmann::json bars_to_json(const std::vector<Bar>& bars) {
+    nlohmann::json j = nlohmann::json::array();
+    for (const Bar& bar : bars) {
+        j.push_back({
+            {"instrument_id", bar.instrument_id},
+            {"interval_ms", bar.interval_ns / 1'000'000},
+            {"start", bar.start_ns},
+            {"open", bar.open},
+            {"high", bar.high},
+            {"low", bar.low},
+            {"close", bar.close},
+            {"volume", bar.volume},
+            {"trades", bar.trades},
+            {"vwap", bar.vwap()},
+        });
+    }
+    return j;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <databento/record.hpp>
+#include <nlohmann/json.hpp>
+
+// OHLCV / VWAP bars from Action::Trade events, several intervals at once.
+// Runs next to OrderBook on the same messages. Fills are skipped, they
+// repeat the passive side of a trade that was already counted.
+struct Bar {
+    std::uint32_t instrument_id = 0;
+    std::uint64_t interval_ns = 0;
+    std::uint64_t start_ns = 0; // ts_event bucket start
+    std::int64_t open = 0;
+    std::int64_t high = 0;
+    std::int64_t low = 0;
+    std::int64_t close = 0;
+    std::uint64_t volume = 0;
+    std::uint64_t trades = 0;
+    long double notional = 0; // sum(price * size), raw price units
+
+    double vwap() const {
+        return volume == 0 ? 0.0 : static_cast<double>(notional / static_cast<long double>(volume));
+    }
+};
+
+struct Trade {
+    std::uint64_t ts_event = 0;
+    std::int64_t price = 0;
+    std::uint32_t size = 0;
+    char side = 'N'; // aggressor
+};
+
+class BarAggregator {
+public:
+    explicit BarAggregator(std::vector<std::uint64_t> intervals_ns);
+
+    // O(1) per interval: closes bars the message's time has moved past and
+    // folds trades into the open ones
+    void on_event(const databento::MboMsg& ev);
+
+    // Bars closed since the last call
+    std::vector<Bar> take_closed();
+
+    // Closes every open bar, e.g. at end of replay
+    void flush();
+
+    bool enabled() const { return !intervals_ns_.empty(); }
+
+    nlohmann::json last_trades_json() const;
+
+private:
+    struct InstrumentState {
+        std::vector<Bar> open; // one per interval, trades == 0 means none yet
+        Trade last_trade;
+    };
+
+    std::vector<std::uint64_t> intervals_ns_;
+    std::unordered_map<std::uint32_t, InstrumentState> instruments_;
+    std::vector<Bar> closed_;
+};
+
+nlohmann::json bars_to_json(const std::vector<Bar>& bars);
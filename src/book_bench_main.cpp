@@ -0,0 +1,252 @@
+#include <malloc.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "order_book.hpp"
+
+// Sequential Apply vs ApplyBatch on a large book that doesn't fit in cache,
+// Apply vs LoadSnapshot for building it from a snapshot, and heap bytes per
+// live order, for every PolicyBook preset.
+// Usage: book_bench [live-orders] [messages] [levels-per-side]
+
+namespace
+{
+
+struct Workload
+{
+    std::vector<db::MboMsg> preload; // adds that build the initial book
+    std::vector<db::MboMsg> stream;  // cancels / modifies / adds on it
+};
+
+db::MboMsg MakeMsg(db::Action action, db::Side side, uint64_t order_id,
+                   int64_t price, uint32_t size)
+{
+    db::MboMsg mbo{};
+    mbo.hd.length = sizeof(db::MboMsg) / db::RecordHeader::kLengthMultiplier;
+    mbo.action = action;
+    mbo.side = side;
+    mbo.order_id = order_id;
+    mbo.price = price;
+    mbo.size = size;
+    return mbo;
+}
+
+Workload MakeWorkload(std::size_t live_orders, std::size_t messages,
+                      std::size_t levels_per_side)
+{
+    constexpr int64_t kMid = 65'000'000'000;
+    constexpr int64_t kTick = 10'000'000;
+
+    std::mt19937_64 rng{42};
+    Workload w;
+    struct Live
+    {
+        uint64_t id;
+        int64_t price;
+        uint32_t size;
+        db::Side side;
+    };
+    std::vector<Live> live;
+    live.reserve(live_orders);
+    uint64_t next_id = 1;
+
+    auto random_order = [&]
+    {
+        db::Side side = rng() % 2 ? db::Side::Bid : db::Side::Ask;
+        auto offset = static_cast<int64_t>(1 + rng() % levels_per_side) * kTick;
+        int64_t price = side == db::Side::Bid ? kMid - offset : kMid + offset;
+        return Live{next_id++, price, static_cast<uint32_t>(1 + rng() % 50), side};
+    };
+
+    for (std::size_t i = 0; i < live_orders; ++i)
+    {
+        Live o = random_order();
+        live.push_back(o);
+        w.preload.push_back(MakeMsg(db::Action::Add, o.side, o.id, o.price, o.size));
+    }
+
+    w.stream.reserve(messages);
+    for (std::size_t i = 0; i < messages; ++i)
+    {
+        auto kind = rng() % 3;
+        if (kind == 0 || live.empty())
+        {
+            Live o = random_order();
+            live.push_back(o);
+            w.stream.push_back(MakeMsg(db::Action::Add, o.side, o.id, o.price, o.size));
+            continue;
+        }
+        std::size_t idx = rng() % live.size();
+        Live &o = live[idx];
+        if (kind == 1 || o.size == 1)
+        {
+            w.stream.push_back(MakeMsg(db::Action::Cancel, o.side, o.id, o.price, o.size));
+            live[idx] = live.back();
+            live.pop_back();
+        }
+        else
+        {
+            o.size -= 1;
+            w.stream.push_back(MakeMsg(db::Action::Modify, o.side, o.id, o.price, o.size));
+        }
+    }
+    return w;
+}
+
+template <typename Book>
+double RunNsPerMsg(const Workload &w, bool batched)
+{
+    Book book;
+    for (const auto &mbo : w.preload)
+    {
+        book.Apply(mbo);
+    }
+
+    std::size_t errors = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    if (batched)
+    {
+        constexpr std::size_t kBatch = 256;
+        std::span<const db::MboMsg> all{w.stream};
+        for (std::size_t i = 0; i < all.size(); i += kBatch)
+        {
+            book.ApplyBatch(all.subspan(i, std::min(kBatch, all.size() - i)),
+                            [&](const db::MboMsg &, BookError)
+                            { ++errors; });
+        }
+    }
+    else
+    {
+        for (const auto &mbo : w.stream)
+        {
+            try
+            {
+                if (book.Apply(mbo) != BookError::None)
+                {
+                    ++errors;
+                }
+            }
+            catch (const std::logic_error &)
+            {
+                ++errors;
+            }
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (errors != 0)
+    {
+        std::cerr << "Unexpected errors: " << errors << "\n";
+    }
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() /
+           static_cast<double>(w.stream.size());
+}
+
+template <typename Book>
+void Compare(const std::string &name, const Workload &w)
+{
+    // Alternate and keep the best run, allocator state and noisy neighbours
+    // otherwise dominate the difference (+-10% between identical loops)
+    constexpr int kRounds = 5;
+    double seq = 1e18;
+    double batch = 1e18;
+    for (int i = 0; i < kRounds; ++i)
+    {
+        seq = std::min(seq, RunNsPerMsg<Book>(w, false));
+        batch = std::min(batch, RunNsPerMsg<Book>(w, true));
+    }
+    std::cout << name << ": Apply " << seq << " ns/msg, ApplyBatch " << batch
+              << " ns/msg (" << seq / batch << "x)\n";
+}
+
+// Time to build the preload book: Apply per add vs one LoadSnapshot
+template <typename Book>
+void CompareLoad(const std::string &name, const Workload &w)
+{
+    constexpr int kRounds = 5;
+    double seq = 1e18;
+    double bulk = 1e18;
+    for (int i = 0; i < kRounds; ++i)
+    {
+        {
+            Book book;
+            auto t0 = std::chrono::steady_clock::now();
+            for (const auto &mbo : w.preload)
+            {
+                book.Apply(mbo);
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            seq = std::min(seq, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        }
+        {
+            Book book;
+            auto t0 = std::chrono::steady_clock::now();
+            book.LoadSnapshot(w.preload, [](const db::MboMsg &, BookError) {});
+            auto t1 = std::chrono::steady_clock::now();
+            bulk = std::min(bulk, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        }
+    }
+    std::cout << name << ": snapshot via Apply " << seq << " ms, LoadSnapshot " << bulk
+              << " ms (" << seq / bulk << "x)\n";
+}
+
+// Heap bytes held by a book built from the preload, per live order (levels
+// and index included), from glibc's allocator statistics; large tables are
+// mmapped, so hblkhd counts along with the arena
+std::size_t HeapInUse()
+{
+    const struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+template <typename Book>
+double BytesPerOrder(const Workload &w)
+{
+    const std::size_t before = HeapInUse();
+    Book book;
+    for (const auto &mbo : w.preload)
+    {
+        book.Apply(mbo);
+    }
+    const std::size_t after = HeapInUse();
+    return static_cast<double>(after - before) / static_cast<double>(book.OrderCount());
+}
+
+template <typename Book>
+void CompareMemory(const std::string &name, const Workload &w, double dbbook_bytes)
+{
+    const double bytes = BytesPerOrder<Book>(w);
+    std::cout << name << ": " << bytes << " bytes per live order (DBBook / this = "
+              << dbbook_bytes / bytes << "x)\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t live_orders = argc > 1 ? std::stoull(argv[1]) : 2'000'000;
+    std::size_t messages = argc > 2 ? std::stoull(argv[2]) : 2'000'000;
+    std::size_t levels = argc > 3 ? std::stoull(argv[3]) : 50'000;
+
+    std::cout << "live orders=" << live_orders << " messages=" << messages
+              << " levels/side=" << levels << "\n";
+    auto workload = MakeWorkload(live_orders, messages, levels);
+
+    Compare<DBBook>("DBBook (strict)    ", workload);
+    Compare<DBLevelBook>("DBLevelBook (mbp)  ", workload);
+    Compare<PolicyBook<CountingBookPolicy>>("PolicyBook counting", workload);
+    Compare<PolicyBook<TrustedBookPolicy>>("PolicyBook trusted ", workload);
+    CompareLoad<DBBook>("DBBook (strict)    ", workload);
+    CompareLoad<DBLevelBook>("DBLevelBook (mbp)  ", workload);
+    CompareLoad<PolicyBook<CountingBookPolicy>>("PolicyBook counting", workload);
+    CompareLoad<PolicyBook<TrustedBookPolicy>>("PolicyBook trusted ", workload);
+    const double dbbook_bytes = BytesPerOrder<DBBook>(workload);
+    CompareMemory<DBBook>("DBBook (strict)    ", workload, dbbook_bytes);
+    CompareMemory<DBLevelBook>("DBLevelBook (mbp)  ", workload, dbbook_bytes);
+    CompareMemory<PolicyBook<CountingBookPolicy>>("PolicyBook counting", workload, dbbook_bytes);
+    CompareMemory<PolicyBook<TrustedBookPolicy>>("PolicyBook trusted ", workload, dbbook_bytes);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+// Why the book rejected a message. PolicyBook::Apply returns it (None when
+// the message was applied), /metrics counts errors by it.
+enum class BookError : std::uint8_t {
+    None,
+    DuplicateId,   // add of an id that is already live
+    UnknownOrder,  // cancel of an id that isn't live, or at another side / price
+    OverCancel,    // cancel of more than the order's size
+    ChangedSide,   // modify to the other side
+    InvalidSide,   // side is neither bid nor ask
+    UnknownLevel,  // the order's level is missing (index and levels disagree)
+    UnknownAction,
+    Other,         // anything else thrown while applying
+    Count_,
+};
+
+inline const char* to_string(BookError error) {
+    constexpr const char* kLabels[] = {
+        "none", "duplicate_id", "unknown_order", "over_cancel", "changed_side",
+        "invalid_side", "unknown_level", "unknown_action", "other",
+    };
+    static_assert(std::size(kLabels) == static_cast<std::size_t>(BookError::Count_));
+    return kLabels[static_cast<std::size_t>(error)];
+}
+
+// What Validation::Strict throws: the usual exception type and message,
+// plus the reason
+template <typename Exception>
+class BookRejection : public Exception {
+public:
+    BookRejection(BookError reason, const std::string& message)
+        : Exception(message), reason_(reason) {}
+    BookError reason() const { return reason_; }
+
+private:
+    BookError reason_;
+};
+
+inline BookError reason_of(const std::exception& ex) {
+    if (auto* r = dynamic_cast<const BookRejection<std::invalid_argument>*>(&ex)) return r->reason();
+    if (auto* r = dynamic_cast<const BookRejection<std::logic_error>*>(&ex)) return r->reason();
+    return BookError::Other;
+}
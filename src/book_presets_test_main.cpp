@@ -0,0 +1,310 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "dbn_reader.hpp"
+#include "order_book.hpp"
+
+// Every PolicyBook preset must build the same book: the DBN file is replayed
+// through each of them (Apply, ApplyBatch) and compared with DBBook message by
+// message, then small hand-made books cover TOB, over-cancel, duplicate and
+// side-change input, and LoadSnapshot is compared with Apply.
+// Usage: book_presets_test <path-to-dbn>
+
+namespace
+{
+
+int failures = 0;
+
+void Check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        if (failures < 20)
+        {
+            std::cerr << "FAIL: " << what << "\n";
+        }
+        ++failures;
+    }
+}
+
+db::MboMsg Msg(db::Action action, db::Side side, uint64_t order_id, int64_t price,
+               uint32_t size, uint8_t flags = 0)
+{
+    db::MboMsg mbo{};
+    mbo.hd.length = sizeof(db::MboMsg) / db::RecordHeader::kLengthMultiplier;
+    mbo.action = action;
+    mbo.side = side;
+    mbo.order_id = order_id;
+    mbo.price = price;
+    mbo.size = size;
+    mbo.flags = db::FlagSet{flags};
+    return mbo;
+}
+
+template <typename Book>
+BookError ApplyOne(Book &book, const db::MboMsg &mbo)
+{
+    try
+    {
+        return book.Apply(mbo);
+    }
+    catch (const std::logic_error &ex)
+    {
+        return reason_of(ex);
+    }
+}
+
+bool SameLevels(const std::vector<db::BidAskPair> &a, const std::vector<db::BidAskPair> &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+        if (a[i].bid_px != b[i].bid_px || a[i].bid_sz != b[i].bid_sz ||
+            a[i].bid_ct != b[i].bid_ct || a[i].ask_px != b[i].ask_px ||
+            a[i].ask_sz != b[i].ask_sz || a[i].ask_ct != b[i].ask_ct)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Full depth of both sides
+template <typename Book>
+std::vector<db::BidAskPair> Levels(const Book &book)
+{
+    auto [bids, asks] = book.BidAskLevelCounts();
+    return book.GetSnapshot(std::max<std::size_t>(
+        {static_cast<std::size_t>(bids), static_cast<std::size_t>(asks), 1}));
+}
+
+// Per-message errors and a snapshot every kEvery messages, plus the final book
+struct Replay
+{
+    static constexpr std::size_t kEvery = 64;
+    std::vector<BookError> errors;
+    std::vector<std::vector<db::BidAskPair>> snapshots;
+    std::size_t orders = 0;
+};
+
+template <typename Book>
+Replay Run(const std::vector<db::MboMsg> &msgs, bool batched)
+{
+    Book book;
+    Replay out;
+    out.errors.resize(msgs.size(), BookError::None);
+    for (std::size_t i = 0; i < msgs.size(); i += Replay::kEvery)
+    {
+        std::span<const db::MboMsg> chunk{msgs.data() + i,
+                                          std::min(Replay::kEvery, msgs.size() - i)};
+        if (batched)
+        {
+            book.ApplyBatch(chunk, [&](const db::MboMsg &mbo, BookError error)
+                            { out.errors[static_cast<std::size_t>(&mbo - msgs.data())] = error; });
+        }
+        else
+        {
+            for (std::size_t k = 0; k < chunk.size(); ++k)
+            {
+                out.errors[i + k] = ApplyOne(book, chunk[k]);
+            }
+        }
+        out.snapshots.push_back(Levels(book));
+    }
+    out.orders = book.OrderCount();
+    return out;
+}
+
+template <typename Book>
+void CompareReplay(const std::string &name, const std::vector<db::MboMsg> &msgs,
+                   const Replay &expected)
+{
+    for (bool batched : {false, true})
+    {
+        const Replay got = Run<Book>(msgs, batched);
+        const std::string what = name + (batched ? " ApplyBatch" : " Apply");
+        std::size_t errors = 0;
+        for (std::size_t i = 0; i < msgs.size(); ++i)
+        {
+            errors += got.errors[i] != BookError::None;
+            Check(got.errors[i] == expected.errors[i],
+                  what + ": message " + std::to_string(i) + " gave " + to_string(got.errors[i]) +
+                      ", DBBook " + to_string(expected.errors[i]));
+        }
+        for (std::size_t i = 0; i < got.snapshots.size(); ++i)
+        {
+            Check(SameLevels(got.snapshots[i], expected.snapshots[i]),
+                  what + ": book differs after message " +
+                      std::to_string(std::min((i + 1) * Replay::kEvery, msgs.size())));
+        }
+        Check(got.orders == expected.orders, what + ": order count differs");
+        std::cout << what << ": " << msgs.size() << " messages, " << errors << " errors\n";
+    }
+}
+
+// Hand-made cases; `trusting` presets take the index over the message
+template <typename Book>
+void InjectedCases(const std::string &name)
+{
+    constexpr bool trusting = Book::kValidation == Validation::Trusting;
+    using A = db::Action;
+    using S = db::Side;
+    auto expect = [&](bool ok, const std::string &what) { Check(ok, name + ": " + what); };
+
+    {
+        Book book;
+        ApplyOne(book, Msg(A::Add, S::Bid, 1, 100, 10));
+        expect(ApplyOne(book, Msg(A::Add, S::Bid, 1, 101, 5)) == BookError::DuplicateId,
+               "duplicate add rejected");
+        const PriceLevel bid = book.GetBidLevel();
+        expect(bid.price == 100 && bid.size == 10 && bid.count == 1,
+               "duplicate add leaves the book unchanged");
+        expect(book.OrderCount() == 1, "duplicate add not counted");
+    }
+    {
+        Book book;
+        ApplyOne(book, Msg(A::Add, S::Ask, 2, 200, 10));
+        const BookError error = ApplyOne(book, Msg(A::Cancel, S::Ask, 2, 200, 15));
+        if constexpr (trusting)
+        {
+            expect(error == BookError::None, "over-cancel clamped");
+            expect(!book.GetAskLevel() && book.OrderCount() == 0, "over-cancel removes the order");
+        }
+        else
+        {
+            expect(error == BookError::OverCancel, "over-cancel rejected");
+            expect(book.GetAskLevel().size == 10, "over-cancel leaves the order");
+        }
+    }
+    {
+        Book book;
+        ApplyOne(book, Msg(A::Add, S::Bid, 5, 100, 10));
+        const BookError error = ApplyOne(book, Msg(A::Modify, S::Ask, 5, 100, 4));
+        if constexpr (trusting)
+        {
+            expect(error == BookError::None, "side change applied to the indexed side");
+            expect(book.GetBidLevel().size == 4 && !book.GetAskLevel(),
+                   "side change stays on the bid");
+        }
+        else
+        {
+            expect(error == BookError::ChangedSide, "side change rejected");
+            expect(book.GetBidLevel().size == 10, "side change leaves the order");
+        }
+    }
+    {
+        Book book;
+        ApplyOne(book, Msg(A::Add, S::Bid, 3, 100, 10));
+        ApplyOne(book, Msg(A::Add, S::Bid, 4, 101, 5));
+        ApplyOne(book, Msg(A::Add, S::Ask, 6, 110, 8));
+        expect(ApplyOne(book, Msg(A::Add, S::Bid, 9, 99, 7, db::FlagSet::kTob)) == BookError::None,
+               "TOB add applied");
+        PriceLevel bid = book.GetBidLevel();
+        expect(bid.price == 99 && bid.size == 7 && bid.count == 0 && !book.GetBidLevel(1),
+               "TOB add replaces the bid side");
+        expect(book.GetAskLevel().size == 8, "TOB add leaves the other side");
+        expect(book.OrderCount() == 1, "orders dropped by the TOB add are not counted");
+        expect(ApplyOne(book, Msg(A::Cancel, S::Bid, 3, 100, 10)) == BookError::UnknownOrder,
+               "order dropped by the TOB add is gone");
+
+        expect(ApplyOne(book, Msg(A::Add, S::Bid, 9, 98, 3, db::FlagSet::kTob)) == BookError::None,
+               "repeated TOB id accepted");
+        bid = book.GetBidLevel();
+        expect(bid.price == 98 && bid.size == 3 && !book.GetBidLevel(1), "repeated TOB replaces it");
+        expect(ApplyOne(book, Msg(A::Cancel, S::Bid, 9, 98, 3)) == BookError::None,
+               "TOB order cancelled");
+        expect(!book.GetBidLevel(), "TOB cancel empties the level");
+
+        ApplyOne(book, Msg(A::Add, S::Ask, 10, 111, 2, db::FlagSet::kTob));
+        expect(ApplyOne(book, Msg(A::Add, S::Ask, 0, db::kUndefPrice, 0, db::FlagSet::kTob)) ==
+                   BookError::None,
+               "TOB clear applied");
+        expect(!book.GetAskLevel(), "TOB clear empties the side");
+    }
+}
+
+// LoadSnapshot against Apply on a shuffled run with duplicate ids
+template <typename Book>
+void CompareLoad(const std::string &name)
+{
+    std::mt19937_64 rng{5};
+    std::vector<db::MboMsg> run;
+    for (int i = 0; i < 50'000; ++i)
+    {
+        const db::Side side = rng() & 1 ? db::Side::Bid : db::Side::Ask;
+        const int64_t base = side == db::Side::Bid ? 1000 : 1500;
+        run.push_back(Msg(db::Action::Add, side, rng() % 40'000,
+                          base + static_cast<int64_t>(rng() % 400) - 200,
+                          1 + static_cast<uint32_t>(rng() % 50), db::FlagSet::kSnapshot));
+    }
+    run[100].order_id = ~uint64_t{0};
+    run[200].order_id = ~uint64_t{0};
+
+    Book applied;
+    std::size_t apply_errors = 0;
+    for (const auto &mbo : run)
+    {
+        apply_errors += ApplyOne(applied, mbo) != BookError::None;
+    }
+    Book loaded;
+    std::size_t load_errors = 0;
+    loaded.LoadSnapshot(run, [&](const db::MboMsg &, BookError) { ++load_errors; });
+
+    Check(load_errors == apply_errors, name + ": LoadSnapshot errors differ from Apply");
+    Check(loaded.OrderCount() == applied.OrderCount(), name + ": LoadSnapshot order count");
+    Check(SameLevels(Levels(loaded), Levels(applied)), name + ": LoadSnapshot book differs");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: book_presets_test <path-to-dbn>\n";
+        return 1;
+    }
+
+    std::vector<db::MboMsg> msgs;
+    try
+    {
+        DbnReader reader{argv[1]};
+        while (auto ev = reader.next())
+        {
+            msgs.push_back(*ev);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Exception: " << ex.what() << "\n";
+        return 1;
+    }
+
+    const Replay expected = Run<DBBook>(msgs, false);
+    CompareReplay<DBBook>("DBBook", msgs, expected);
+    CompareReplay<DBLevelBook>("DBLevelBook", msgs, expected);
+    CompareReplay<PolicyBook<CountingBookPolicy>>("counting", msgs, expected);
+    CompareReplay<PolicyBook<TrustedBookPolicy>>("trusted", msgs, expected);
+
+    InjectedCases<DBBook>("DBBook");
+    InjectedCases<DBLevelBook>("DBLevelBook");
+    InjectedCases<PolicyBook<CountingBookPolicy>>("counting");
+    InjectedCases<PolicyBook<TrustedBookPolicy>>("trusted");
+
+    CompareLoad<DBBook>("DBBook");
+    CompareLoad<DBLevelBook>("DBLevelBook");
+    CompareLoad<PolicyBook<CountingBookPolicy>>("counting");
+    CompareLoad<PolicyBook<TrustedBookPolicy>>("trusted");
+
+    if (failures)
+    {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All presets agree\n";
+    return 0;
+}
@@ -1,14 +1,145 @@
 #include "config.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
 #include <stdexcept>
 #include <string_view>
 
+std::uint64_t parse_time_ns(std::string_view text) {
+    auto to_int = [&](std::string_view part) {
+        std::uint64_t v = 0;
+        auto [p, ec] = std::from_chars(part.data(), part.data() + part.size(), v);
+        if (ec != std::errc{} || p != part.data() + part.size() || part.empty()) {
+            throw std::runtime_error("Invalid time: " + std::string(text));
+        }
+        return v;
+    };
+
+    if (text.find_first_not_of("0123456789") == std::string_view::npos) {
+        return to_int(text);
+    }
+
+    // YYYY-MM-DDTHH:MM:SS[.fffffffff]
+    if (text.size() < 19 || text[4] != '-' || text[7] != '-' ||
+        (text[10] != 'T' && text[10] != ' ') || text[13] != ':' || text[16] != ':') {
+        throw std::runtime_error("Invalid time: " + std::string(text));
+    }
+    using namespace std::chrono;
+    const year_month_day date{year{static_cast<int>(to_int(text.substr(0, 4)))},
+                              month{static_cast<unsigned>(to_int(text.substr(5, 2)))},
+                              day{static_cast<unsigned>(to_int(text.substr(8, 2)))}};
+    if (!date.ok()) {
+        throw std::runtime_error("Invalid date: " + std::string(text));
+    }
+    std::uint64_t ns = static_cast<std::uint64_t>(
+        duration_cast<nanoseconds>(sys_days{date}.time_since_epoch()).count());
+    ns += to_int(text.substr(11, 2)) * 3'600'000'000'000ULL;
+    ns += to_int(text.substr(14, 2)) * 60'000'000'000ULL;
+    ns += to_int(text.substr(17, 2)) * 1'000'000'000ULL;
+
+    auto frac = text.substr(19);
+    if (!frac.empty()) {
+        if (frac[0] != '.' || frac.size() > 10) {
+            throw std::runtime_error("Invalid time: " + std::string(text));
+        }
+        frac.remove_prefix(1);
+        std::uint64_t sub = to_int(frac);
+        for (std::size_t i = frac.size(); i < 9; ++i) sub *= 10;
+        ns += sub;
+    }
+    return ns;
+}
+
+std::vector<FeedEndpoint> parse_feeds(std::string_view text) {
+    std::vector<FeedEndpoint> out;
+    while (!text.empty()) {
+        auto comma = text.find(',');
+        std::string item{text.substr(0, comma)};
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+
+        auto colon = item.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == item.size()) {
+            throw std::runtime_error("Invalid feed, expected host:port: " + item);
+        }
+        out.push_back(FeedEndpoint{item.substr(0, colon), std::stoi(item.substr(colon + 1))});
+    }
+    return out;
+}
+
+std::vector<std::uint64_t> parse_intervals(std::string_view text) {
+    std::vector<std::uint64_t> out;
+    while (!text.empty()) {
+        auto comma = text.find(',');
+        std::string item{text.substr(0, comma)};
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+
+        std::size_t pos = 0;
+        std::uint64_t value = std::stoull(item, &pos);
+        std::string_view unit = std::string_view{item}.substr(pos);
+        std::uint64_t scale = 0;
+        if (unit == "ms")     scale = 1'000'000ULL;
+        else if (unit == "s") scale = 1'000'000'000ULL;
+        else if (unit == "m") scale = 60'000'000'000ULL;
+        else if (unit == "h") scale = 3'600'000'000'000ULL;
+        if (scale == 0 || value == 0) {
+            throw std::runtime_error("Invalid bar interval: " + item);
+        }
+        out.push_back(value * scale);
+    }
+    return out;
+}
+
+std::vector<std::uint64_t> parse_rates(std::string_view text) {
+    std::vector<std::uint64_t> out;
+    while (!text.empty()) {
+        auto comma = text.find(',');
+        out.push_back(std::stoull(std::string(text.substr(0, comma))));
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+    }
+    return out;
+}
+
+// The AVX2 signal kernel is only built for x86 (signals.cpp)
+static bool cpu_has_avx2() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+SignalKernel parse_signal_kernel(std::string_view text) {
+    SignalKernel kernel;
+    if (text == "off")         return SignalKernel::Off;
+    else if (text == "scalar") return SignalKernel::Scalar;
+    else if (text == "avx2" || text == "auto") kernel = SignalKernel::Avx2;
+    else throw std::runtime_error("Unknown signal kernel: " + std::string(text));
+
+    if (!cpu_has_avx2()) {
+        if (text == "avx2") std::cerr << "AVX2 not available, using scalar signals\n";
+        kernel = SignalKernel::Scalar;
+    }
+    return kernel;
+}
+
+const char* to_string(SignalKernel kernel) {
+    switch (kernel) {
+        case SignalKernel::Off:    return "off";
+        case SignalKernel::Scalar: return "scalar";
+        case SignalKernel::Avx2:   return "avx2";
+    }
+    return "?";
+}
+
 Options parse_options(int argc, char** argv) {
     if (argc < 2) {
-        throw std::runtime_error("Usage: mbo_app --mode=[replay|streamer|engine] [options]");
+        throw std::runtime_error("Usage: mbo_app --mode=[replay|streamer|engine|index] [options]");
     }
 
     Options opts;
+    std::optional<BookMode> book_mode;
 
     // Very dumb parsing just for starting point
     for (int i = 1; i < argc; ++i) {
@@ -19,6 +150,7 @@ Options parse_options(int argc, char** argv) {
             if (v == "replay")      opts.mode = Mode::Replay;
             else if (v == "streamer") opts.mode = Mode::Streamer;
             else if (v == "engine")   opts.mode = Mode::Engine;
+            else if (v == "index")    opts.mode = Mode::Index;
             else throw std::runtime_error("Unknown mode: " + std::string(v));
         } else if (arg.rfind("--dbn=", 0) == 0) {
             opts.dbn_path = std::string(arg.substr(6));
@@ -30,15 +162,73 @@ Options parse_options(int argc, char** argv) {
             opts.rate = std::stoull(std::string(arg.substr(7)));
         } else if (arg.rfind("--host=", 0) == 0) {
             opts.host = std::string(arg.substr(7));
+        } else if (arg.rfind("--feeds=", 0) == 0) {
+            opts.feeds = parse_feeds(arg.substr(8));
+        } else if (arg.rfind("--delay-us=", 0) == 0) {
+            opts.delay_us = std::stoull(std::string(arg.substr(11)));
+        } else if (arg.rfind("--jitter-us=", 0) == 0) {
+            opts.jitter_us = std::stoull(std::string(arg.substr(12)));
+        } else if (arg.rfind("--loss-pct=", 0) == 0) {
+            opts.loss_pct = std::stod(std::string(arg.substr(11)));
+        } else if (arg == "--wire-ts") {
+            opts.wire_ts = true;
+        } else if (arg.rfind("--rate-steps=", 0) == 0) {
+            opts.rate_steps = parse_rates(arg.substr(13));
+        } else if (arg.rfind("--step-records=", 0) == 0) {
+            opts.step_records = std::max<std::uint64_t>(1, std::stoull(std::string(arg.substr(15))));
         } else if (arg.rfind("--levels=", 0) == 0) {
             opts.order_book_levels = static_cast<std::uint32_t>(
                 std::stoul(std::string(arg.substr(9))));
+        } else if (arg.rfind("--book=", 0) == 0) {
+            auto v = arg.substr(7);
+            if (v == "mbo" || v == "strict") book_mode = BookMode::Mbo;
+            else if (v == "mbp")      book_mode = BookMode::Mbp;
+            else if (v == "counting") book_mode = BookMode::Counting;
+            else if (v == "trusted")  book_mode = BookMode::Trusted;
+            else throw std::runtime_error("Unknown book mode: " + std::string(v));
+        } else if (arg.rfind("--batch=", 0) == 0) {
+            opts.batch = std::max<std::size_t>(1, std::stoull(std::string(arg.substr(8))));
+        } else if (arg.rfind("--bars=", 0) == 0) {
+            opts.bar_intervals_ns = parse_intervals(arg.substr(7));
+        } else if (arg.rfind("--signals=", 0) == 0) {
+            opts.signal_kernel = parse_signal_kernel(arg.substr(10));
+        } else if (arg.rfind("--signal-levels=", 0) == 0) {
+            opts.signal_levels = std::min<std::size_t>(
+                kMaxSignalLevels, std::stoull(std::string(arg.substr(16))));
+        } else if (arg.rfind("--signal-depth-px=", 0) == 0) {
+            opts.signal_depth_px = std::stoll(std::string(arg.substr(18)));
+        } else if (arg == "--low-latency") {
+            opts.low_latency = true;
+        } else if (arg.rfind("--cpu=", 0) == 0) {
+            opts.cpu = std::stoi(std::string(arg.substr(6)));
+        } else if (arg.rfind("--prefault-mb=", 0) == 0) {
+            opts.prefault_mb = std::stoull(std::string(arg.substr(14)));
+        } else if (arg.rfind("--metrics-port=", 0) == 0) {
+            opts.metrics_port = std::stoi(std::string(arg.substr(15)));
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            opts.trace_path = std::string(arg.substr(8));
+        } else if (arg.rfind("--start=", 0) == 0) {
+            opts.start_ns = parse_time_ns(arg.substr(8));
+        } else if (arg.rfind("--end=", 0) == 0) {
+            opts.end_ns = parse_time_ns(arg.substr(6));
+        } else if (arg.rfind("--index-every=", 0) == 0) {
+            opts.index_every = std::stoull(std::string(arg.substr(14)));
+        } else if (arg.rfind("--index-interval-ms=", 0) == 0) {
+            opts.index_interval_ns = std::stoull(std::string(arg.substr(20))) * 1'000'000ULL;
         }
     }
 
     if (opts.mode != Mode::Engine && opts.dbn_path.empty()) {
         throw std::runtime_error("Missing --dbn=PATH");
     }
+    opts.book_mode = book_mode.value_or(
+        opts.mode == Mode::Engine ? BookMode::Trusted : BookMode::Counting);
+    if (!opts.low_latency && (opts.cpu || opts.prefault_mb > 0)) {
+        throw std::runtime_error("--cpu and --prefault-mb are part of --low-latency");
+    }
+    if (opts.feeds.size() > 1 && !opts.wire_ts) {
+        throw std::runtime_error("--feeds arbitrates on the frame sequence, run streamers and engine with --wire-ts");
+    }
 
     return opts;
 }
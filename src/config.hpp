@@ -2,18 +2,64 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
 enum class Mode {
     Replay,
     Streamer,
     Engine,
+    Index,
+};
+
+struct FeedEndpoint {
+    std::string host;
+    int port = 0;
+};
+
+// Book signal kernel (signals.hpp)
+enum class SignalKernel {
+    Off,
+    Scalar,
+    Avx2,
+};
+
+// Most levels the signal kernels read (TopOfBook::kMaxLevels), a multiple of
+// the SIMD width
+inline constexpr std::size_t kMaxSignalLevels = 32;
+
+// "off" | "scalar" | "avx2" | "auto"; avx2/auto fall back to scalar when
+// the CPU lacks AVX2
+SignalKernel parse_signal_kernel(std::string_view text);
+const char* to_string(SignalKernel kernel);
+
+// PolicyBook presets (order_book.hpp)
+enum class BookMode {
+    Mbo,      // DBBook: every order kept, every error thrown (--book=mbo|strict)
+    Mbp,      // DBLevelBook: aggregated price levels, same checks
+    Counting, // flat containers, aggregates, errors counted without exceptions
+    Trusted,  // flat containers, aggregates, index trusted over messages
 };
 
 struct Options {
     Mode mode;
     std::string dbn_path;
     std::optional<std::uint32_t> order_book_levels;
+    // Without --book: counting for replay (files are not validated),
+    // trusted for the engine (latency path, validated upstream)
+    BookMode book_mode = BookMode::Counting;
+    // > 1: apply messages in batches (DBBook::ApplyBatch), the engine then
+    // takes one snapshot per received batch instead of per message
+    std::size_t batch = 1;
+    // OHLCV/VWAP bar intervals (--bars=1s,1m,5m), empty = no bars
+    std::vector<std::uint64_t> bar_intervals_ns;
+
+    // Book signals after every Apply (see signals.hpp)
+    SignalKernel signal_kernel = SignalKernel::Off;
+    std::size_t signal_levels = 10;
+    std::int64_t signal_depth_px = 100'000'000; // 0.10 in DBN price units
 
     // For replay
     std::string output_path = "book.json";
@@ -22,6 +68,54 @@ struct Options {
     std::string host = "127.0.0.1";
     int port = 9000;
     std::uint64_t rate = 200000; // msgs per second
+    std::optional<int> metrics_port; // engine: serve /metrics over HTTP
+    // Engine: redundant lines of the same feed (--feeds=host:port,host:port),
+    // arbitrated by FeedArbiter on the --wire-ts frame sequence; empty = the
+    // single --host/--port
+    std::vector<FeedEndpoint> feeds;
+    // Streamer: hold each batch back by delay + uniform [0, jitter] to play
+    // the slow line of an A/B pair, drop loss_pct % of batches to play a
+    // lossy one
+    std::uint64_t delay_us = 0;
+    std::uint64_t jitter_us = 0;
+    double loss_pct = 0.0;
+    // Both sides: frame each batch with its steady_clock send time and line
+    // sequence so the engine can split wire-to-book latency by stage and
+    // arbitrate A/B lines (must match)
+    bool wire_ts = false;
+    // Streamer: step the offered rate every step_records records
+    // (--rate-steps=50000,100000,200000), the engine reports per step
+    std::vector<std::uint64_t> rate_steps;
+    std::uint64_t step_records = 100000;
+
+    // Engine --low-latency profile (see runtime.hpp)
+    bool low_latency = false;
+    std::optional<int> cpu;          // pin the apply thread
+    std::size_t prefault_mb = 0;     // warm hugepage-backed heap for the book
+
+    // Chrome trace-event JSON written at exit / on SIGUSR1 (builds with
+    // -DMBO_TRACE=ON only, see trace.hpp)
+    std::string trace_path;
+
+    // Time window [start, end) as ts_recv in ns since epoch
+    std::optional<std::uint64_t> start_ns;
+    std::optional<std::uint64_t> end_ns;
+
+    // Sidecar index granularity (see dbn_index.hpp)
+    std::uint64_t index_every = 100000;            // records
+    std::uint64_t index_interval_ns = 1'000'000'000; // 1 s
 };
 
 Options parse_options(int argc, char** argv);
+
+// "127.0.0.1:9000,127.0.0.1:9001"
+std::vector<FeedEndpoint> parse_feeds(std::string_view text);
+
+// "1s,1m,5m" -> ns; accepts ms, s, m, h suffixes
+std::vector<std::uint64_t> parse_intervals(std::string_view text);
+
+// "50000,100000,200000" msgs/sec
+std::vector<std::uint64_t> parse_rates(std::string_view text);
+
+// Accepts ns since epoch or UTC "YYYY-MM-DDTHH:MM:SS[.fffffffff]"
+std::uint64_t parse_time_ns(std::string_view text);
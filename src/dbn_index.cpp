@@ -0,0 +1,189 @@
+#include "dbn_index.hpp"
+#include "dbn_reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr char kIndexMagic[8] = {'D', 'B', 'N', 'I', 'D', 'X', '0', '1'};
+
+struct IndexHeader {
+    char magic[8];
+    std::uint64_t dbn_size;  // detects a sidecar left over from another file
+    std::uint64_t every_records;
+    std::uint64_t every_ns;
+    std::uint64_t first_record_offset;
+    std::uint64_t checkpoint_count;
+    std::uint64_t clear_count;
+    std::uint64_t snapshot_count;
+};
+
+void write_entries(std::ofstream& out, const std::vector<DbnIndexEntry>& entries) {
+    out.write(reinterpret_cast<const char*>(entries.data()),
+              static_cast<std::streamsize>(entries.size() * sizeof(DbnIndexEntry)));
+}
+
+bool read_entries(std::ifstream& in, std::vector<DbnIndexEntry>& entries, std::uint64_t count) {
+    entries.resize(count);
+    return static_cast<bool>(
+        in.read(reinterpret_cast<char*>(entries.data()),
+                static_cast<std::streamsize>(count * sizeof(DbnIndexEntry))));
+}
+
+// Last entry with ts_recv < ts (strict) or <= ts, if any
+std::optional<DbnIndexEntry> last_before(const std::vector<DbnIndexEntry>& entries,
+                                         std::uint64_t ts, bool inclusive) {
+    auto it = inclusive
+        ? std::upper_bound(entries.begin(), entries.end(), ts,
+                           [](std::uint64_t t, const DbnIndexEntry& e) { return t < e.ts_recv; })
+        : std::lower_bound(entries.begin(), entries.end(), ts,
+                           [](const DbnIndexEntry& e, std::uint64_t t) { return e.ts_recv < t; });
+    if (it == entries.begin()) return std::nullopt;
+    return *std::prev(it);
+}
+
+} // namespace
+
+DbnIndexEntry DbnIndex::checkpoint_before(std::uint64_t ts) const {
+    auto entry = last_before(checkpoints, ts, false);
+    return entry.value_or(DbnIndexEntry{0, first_record_offset, 0});
+}
+
+DbnIndexEntry DbnIndex::safe_point_before(std::uint64_t ts) const {
+    DbnIndexEntry best{0, first_record_offset, 0};
+    for (const auto* entries : {&clears, &snapshots}) {
+        auto entry = last_before(*entries, ts, true);
+        if (entry && entry->byte_offset > best.byte_offset) best = *entry;
+    }
+    return best;
+}
+
+std::string dbn_index_path(const std::string& dbn_path) {
+    return dbn_path + ".idx";
+}
+
+DbnIndex build_dbn_index(const std::string& dbn_path,
+                         std::uint64_t every_records,
+                         std::uint64_t every_ns) {
+    DbnIndex index;
+    index.every_records = every_records;
+    index.every_ns = every_ns;
+    index.dbn_size = std::filesystem::file_size(dbn_path);
+    index.first_record_offset = DbnReader::first_record_offset(dbn_path);
+
+    DbnReader reader{dbn_path};
+    reader.seek(index.first_record_offset);
+
+    std::uint64_t count = 0;
+    std::uint64_t last_checkpoint_ts = 0;
+    std::uint64_t last_checkpoint_count = 0;
+    bool in_snapshot = false;
+
+    std::uint64_t offset = reader.offset();
+    while (auto msg = reader.next()) {
+        const std::uint64_t ts = msg->ts_recv.time_since_epoch().count();
+        const DbnIndexEntry entry{ts, offset, count};
+
+        bool due = index.checkpoints.empty();
+        if (every_records > 0 && count - last_checkpoint_count >= every_records) due = true;
+        if (every_ns > 0 && ts >= last_checkpoint_ts + every_ns) due = true;
+        if (due) {
+            index.checkpoints.push_back(entry);
+            last_checkpoint_ts = ts;
+            last_checkpoint_count = count;
+        }
+
+        if (msg->action == databento::Action::Clear) {
+            index.clears.push_back(entry);
+        }
+        const bool snapshot = msg->flags.IsSnapshot();
+        if (snapshot && !in_snapshot) {
+            index.snapshots.push_back(entry);
+        }
+        in_snapshot = snapshot;
+
+        ++count;
+        offset = reader.offset();
+    }
+
+    return index;
+}
+
+void write_dbn_index(const DbnIndex& index, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (out.fail()) {
+        throw std::runtime_error("Failed to open index file: " + path);
+    }
+
+    IndexHeader header{};
+    std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.dbn_size = index.dbn_size;
+    header.every_records = index.every_records;
+    header.every_ns = index.every_ns;
+    header.first_record_offset = index.first_record_offset;
+    header.checkpoint_count = index.checkpoints.size();
+    header.clear_count = index.clears.size();
+    header.snapshot_count = index.snapshots.size();
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_entries(out, index.checkpoints);
+    write_entries(out, index.clears);
+    write_entries(out, index.snapshots);
+    if (out.fail()) {
+        throw std::runtime_error("Failed to write index file: " + path);
+    }
+}
+
+std::optional<DbnIndex> read_dbn_index(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return std::nullopt;
+
+    IndexHeader header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0) {
+        return std::nullopt;
+    }
+
+    DbnIndex index;
+    index.dbn_size = header.dbn_size;
+    index.every_records = header.every_records;
+    index.every_ns = header.every_ns;
+    index.first_record_offset = header.first_record_offset;
+    if (!read_entries(in, index.checkpoints, header.checkpoint_count) ||
+        !read_entries(in, index.clears, header.clear_count) ||
+        !read_entries(in, index.snapshots, header.snapshot_count)) {
+        return std::nullopt;
+    }
+    return index;
+}
+
+DbnIndex load_or_build_dbn_index(const std::string& dbn_path,
+                                 std::uint64_t every_records,
+                                 std::uint64_t every_ns) {
+    const std::string path = dbn_index_path(dbn_path);
+    auto index = read_dbn_index(path);
+    if (index && index->dbn_size == std::filesystem::file_size(dbn_path)) {
+        return *index;
+    }
+
+    // missing or stale (built for a different file)
+    index = build_dbn_index(dbn_path, every_records, every_ns);
+    try {
+        write_dbn_index(*index, path);
+    } catch (const std::runtime_error& ex) {
+        // e.g. read-only data directory: the index in memory still works,
+        // it is just rebuilt next time
+        std::cerr << "Warning: " << ex.what() << ", using the index without saving it\n";
+        return *index;
+    }
+    std::cerr << "Wrote DBN index to " << path << " ("
+              << index->checkpoints.size() << " checkpoints, "
+              << index->clears.size() << " clears, "
+              << index->snapshots.size() << " snapshots)\n";
+    return *index;
+}
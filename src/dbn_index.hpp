@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Sidecar index for uncompressed DBN files, stored next to the data as
+// <file>.idx, so replay can start at any ts_recv without decoding
+// everything before it.
+struct DbnIndexEntry {
+    std::uint64_t ts_recv = 0;
+    std::uint64_t byte_offset = 0;   // from the start of the .dbn file
+    std::uint64_t record_count = 0;  // records before this one
+};
+
+struct DbnIndex {
+    std::uint64_t dbn_size = 0;  // detects a sidecar left over from another file
+    std::uint64_t every_records = 0;
+    std::uint64_t every_ns = 0;
+    std::uint64_t first_record_offset = 0;
+
+    std::vector<DbnIndexEntry> checkpoints; // every N records or T ns
+    std::vector<DbnIndexEntry> clears;      // Action::Clear records
+    std::vector<DbnIndexEntry> snapshots;   // first record of each F_SNAPSHOT run
+
+    // Latest checkpoint strictly before ts, records from there on still
+    // need to be skipped up to ts. Falls back to the first record.
+    DbnIndexEntry checkpoint_before(std::uint64_t ts) const;
+
+    // Latest Clear / snapshot boundary at or before ts, i.e. the closest
+    // position from which the book can be rebuilt from scratch. Falls back
+    // to the first record.
+    DbnIndexEntry safe_point_before(std::uint64_t ts) const;
+};
+
+std::string dbn_index_path(const std::string& dbn_path);
+
+DbnIndex build_dbn_index(const std::string& dbn_path,
+                         std::uint64_t every_records,
+                         std::uint64_t every_ns);
+
+void write_dbn_index(const DbnIndex& index, const std::string& path);
+std::optional<DbnIndex> read_dbn_index(const std::string& path);
+
+// Reads the sidecar next to dbn_path, building and saving it if missing
+DbnIndex load_or_build_dbn_index(const std::string& dbn_path,
+                                 std::uint64_t every_records,
+                                 std::uint64_t every_ns);
@@ -1,15 +1,81 @@
 #include "dbn_reader.hpp"
 
-DbnReader::DbnReader(const std::string& file): store_(file)
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+DbnReader::DbnReader(const std::string& file): path_(file), store_(file)
 {
 }
 
 std::optional<databento::MboMsg> DbnReader::next()
 {
-    if (const databento::Record *rec = store_.NextRecord())
+    std::optional<databento::MboMsg> mbo;
+    if (raw_.is_open())
+    {
+        mbo = next_raw();
+    }
+    else if (const databento::Record *rec = store_.NextRecord())
+    {
+        mbo = rec->Get<databento::MboMsg>();
+    }
+
+    if (mbo && end_ns_ && mbo->ts_recv.time_since_epoch().count() >= *end_ns_)
+    {
+        return std::nullopt;
+    }
+    return mbo;
+}
+
+void DbnReader::seek(std::uint64_t byte_offset)
+{
+    if (!raw_.is_open())
+    {
+        // validates the header, throws on compressed input
+        first_record_offset(path_);
+        raw_.open(path_, std::ios::binary);
+        if (!raw_)
+        {
+            throw std::runtime_error("Failed to open DBN file: " + path_);
+        }
+    }
+    raw_.clear();
+    raw_.seekg(static_cast<std::streamoff>(byte_offset));
+    offset_ = byte_offset;
+}
+
+std::uint64_t DbnReader::first_record_offset(const std::string& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    char header[8];
+    if (!in.read(header, sizeof(header)) || std::memcmp(header, "DBN", 3) != 0)
+    {
+        throw std::runtime_error("Not an uncompressed DBN file: " + file);
+    }
+    std::uint32_t metadata_len;
+    std::memcpy(&metadata_len, header + 4, sizeof(metadata_len));
+    return sizeof(header) + metadata_len;
+}
+
+std::optional<databento::MboMsg> DbnReader::next_raw()
+{
+    // Record header starts with its length in 4-byte words
+    std::uint8_t length_words;
+    if (!raw_.read(reinterpret_cast<char *>(&length_words), 1) || length_words == 0)
     {
-        const auto &mbo = rec->Get<databento::MboMsg>();
-        return mbo;
+        return std::nullopt;
     }
-    return std::nullopt;
+    const std::size_t size =
+        std::size_t{length_words} * databento::RecordHeader::kLengthMultiplier;
+    raw_buf_.resize(size);
+    raw_buf_[0] = static_cast<char>(length_words);
+    if (!raw_.read(raw_buf_.data() + 1, static_cast<std::streamsize>(size - 1)))
+    {
+        return std::nullopt;
+    }
+    offset_ += size;
+
+    databento::MboMsg mbo{};
+    std::memcpy(&mbo, raw_buf_.data(), std::min(size, sizeof(mbo)));
+    return mbo;
 }
@@ -3,6 +3,8 @@
 #include <optional>
 #include <string>
 #include <cstdint>
+#include <fstream>
+#include <vector>
 
 #include "databento/dbn_file_store.hpp"
 
@@ -12,7 +14,28 @@ public:
 
     std::optional<databento::MboMsg> next();
 
+    // Jump to a record boundary (e.g. from a DbnIndex). Only valid for
+    // uncompressed DBN files, records are then read straight from the file.
+    void seek(std::uint64_t byte_offset);
+
+    // Stop iterating at the first record with ts_recv >= end_ns
+    void set_end(std::uint64_t end_ns) { end_ns_ = end_ns; }
+
+    // Byte offset of the next record, only tracked after seek()
+    std::uint64_t offset() const { return offset_; }
+
+    // Byte offset of the first record (right after the DBN metadata)
+    static std::uint64_t first_record_offset(const std::string& file);
+
 private:
+    std::optional<databento::MboMsg> next_raw();
+
+    std::string path_;
     // store databento types here
     databento::DbnFileStore store_;
+
+    std::ifstream raw_;
+    std::vector<char> raw_buf_;
+    std::uint64_t offset_ = 0;
+    std::optional<std::uint64_t> end_ns_;
 };
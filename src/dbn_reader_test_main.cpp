@@ -1,12 +1,14 @@
 #include <iostream>
 #include <optional>
+#include <string>
+#include "dbn_index.hpp"
 #include "dbn_reader.hpp"
 
 int main(int argc, char **argv)
 {
     if (argc < 2)
     {
-        std::cerr << "Usage: dbn_reader_test <path-to-dbn>\n";
+        std::cerr << "Usage: dbn_reader_test <path-to-dbn> [start-ns [end-ns]]\n";
         return 1;
     }
 
@@ -16,8 +18,25 @@ int main(int argc, char **argv)
     {
         DbnReader reader{dbn_path};
 
+        std::uint64_t start_ns = 0;
+        if (argc > 2)
+        {
+            // Jump to the nearest checkpoint, no book state needed here
+            start_ns = std::stoull(argv[2]);
+            auto index = load_or_build_dbn_index(dbn_path, 100000, 1'000'000'000);
+            reader.seek(index.checkpoint_before(start_ns).byte_offset);
+        }
+        if (argc > 3)
+        {
+            reader.set_end(std::stoull(argv[3]));
+        }
+
         while (auto ev = reader.next())
         {
+            if (ev->ts_recv.time_since_epoch().count() < start_ns)
+            {
+                continue;
+            }
             std::cout << "ts=" << ev->hd.ts_event.time_since_epoch().count()
                       << " order_id=" << ev->order_id
                       << " price=" << ev->price
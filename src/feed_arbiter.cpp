@@ -0,0 +1,138 @@
+#include "feed_arbiter.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+using databento::MboMsg;
+
+FeedArbiter::FeedArbiter(std::size_t lines) : ring_(kWindow), lines_(lines) {
+    if (lines == 0) throw std::runtime_error("FeedArbiter needs at least one line");
+    for (auto& line : lines_) line.lag_ns.reserve(1'000'000);
+    out_.reserve(kWindow);
+}
+
+bool FeedArbiter::same(const Seen& seen, const MboMsg& m) {
+    return seen.sequence == m.sequence &&
+           seen.ts_recv == static_cast<std::uint64_t>(m.ts_recv.time_since_epoch().count()) &&
+           seen.order_id == m.order_id &&
+           seen.action == static_cast<char>(m.action);
+}
+
+bool FeedArbiter::has_other_line(std::size_t line) const {
+    for (std::size_t i = 0; i < lines_.size(); ++i) {
+        if (i != line && !lines_[i].closed && !lines_[i].fenced) return true;
+    }
+    return false;
+}
+
+bool FeedArbiter::gap_lost() const {
+    return std::all_of(lines_.begin(), lines_.end(), [&](const LineStats& s) {
+        return s.closed || s.fenced || s.next > next_;
+    });
+}
+
+void FeedArbiter::advance() {
+    if (held_.front()) {
+        out_.push_back(*held_.front());
+        ++applied_;
+    } else {
+        ++skipped_;
+    }
+    held_.pop_front();
+    ++next_;
+}
+
+void FeedArbiter::release() {
+    while (!held_.empty() && (held_.front() || gap_lost())) advance();
+}
+
+std::span<const MboMsg> FeedArbiter::on_records(std::size_t line, std::uint64_t first_seq,
+                                                std::span<const MboMsg> msgs,
+                                                std::uint64_t arrival_ns) {
+    LineStats& stats = lines_[line];
+    out_.clear();
+    stats.delivered += msgs.size();
+    if (first_seq > stats.next) stats.lost += first_seq - stats.next;
+    stats.next = std::max<std::uint64_t>(stats.next, first_seq + msgs.size());
+
+    for (std::size_t k = 0; k < msgs.size(); ++k) {
+        const MboMsg& m = msgs[k];
+        const std::uint64_t seq = first_seq + k;
+        Seen& seen = ring_[seq % kWindow];
+
+        if (seen.seq == seq) {
+            // a copy of a record another line delivered first
+            if (!same(seen, m)) {
+                ++stats.divergent;
+                if (has_other_line(line)) stats.fenced = true;
+                continue;
+            }
+            stats.fenced = false;
+            stats.lag_ns.push_back(arrival_ns - std::min(arrival_ns, seen.arrival_ns));
+            continue;
+        }
+        if (seq < next_) {
+            ++stats.late;
+            continue;
+        }
+        if (stats.fenced) {
+            ++stats.dropped;
+            continue;
+        }
+
+        // first copy; a gap kWindow records back is given up on
+        while (seq >= next_ + kWindow) advance();
+        seen = Seen{seq, static_cast<std::uint64_t>(m.ts_recv.time_since_epoch().count()),
+                    m.order_id, arrival_ns, m.sequence, static_cast<char>(m.action)};
+        const std::uint64_t at = seq - next_;
+        if (held_.size() <= at) held_.resize(at + 1);
+        held_[at] = m;
+        ++stats.wins;
+    }
+    // the gap this line left may be lost now that it is past it
+    release();
+    return out_;
+}
+
+std::span<const MboMsg> FeedArbiter::on_line_closed(std::size_t line) {
+    out_.clear();
+    lines_[line].closed = true;
+    const auto open = std::count_if(lines_.begin(), lines_.end(),
+                                    [](const LineStats& s) { return !s.closed; });
+    if (open == 1) {
+        for (auto& s : lines_) {
+            if (!s.closed) s.fenced = false;
+        }
+    }
+    release();
+    return out_;
+}
+
+void FeedArbiter::print_stats(const std::vector<std::string>& line_names) {
+    std::cerr << "== Feed arbitration ==\n";
+    std::cerr << "Records applied: " << applied_;
+    if (skipped_) std::cerr << ", skipped " << skipped_ << " (no line delivered them)";
+    std::cerr << "\n";
+    for (std::size_t i = 0; i < lines_.size(); ++i) {
+        LineStats& s = lines_[i];
+        const double win_pct = applied_ ? 100.0 * static_cast<double>(s.wins) / applied_ : 0.0;
+        std::cerr << "Line " << i << " [" << (i < line_names.size() ? line_names[i] : "?") << "]"
+                  << ": delivered " << s.delivered << ", first " << s.wins
+                  << " (" << win_pct << "%)";
+        if (!s.lag_ns.empty()) {
+            std::sort(s.lag_ns.begin(), s.lag_ns.end());
+            auto at = [&](double p) {
+                return s.lag_ns[static_cast<std::size_t>(p * (s.lag_ns.size() - 1))] / 1000.0;
+            };
+            std::cerr << ", lag p50/p99/max " << at(0.50) << " / " << at(0.99) << " / "
+                      << s.lag_ns.back() / 1000.0 << " us";
+        }
+        if (s.lost) std::cerr << ", lost " << s.lost;
+        if (s.divergent) std::cerr << ", divergent " << s.divergent;
+        if (s.dropped) std::cerr << ", dropped " << s.dropped << " while fenced";
+        if (s.fenced) std::cerr << ", fenced";
+        if (s.late) std::cerr << ", late " << s.late;
+        std::cerr << "\n";
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <databento/record.hpp>
+
+// A/B line arbitration: merges redundant copies of one feed into a single
+// stream. Every line carries the same records, each stamped by its streamer
+// with a dense line sequence (the --wire-ts frame header holds the first
+// one; MboMsg::sequence is the venue's and repeats within a packet). A
+// frame that starts past the line's last sequence means the line lost
+// records.
+//
+// Records are applied in sequence order, each from whichever line delivered
+// it first. Records after a gap are held until another line fills it; the
+// gap is skipped only once no open line can still deliver it (all of them
+// are past it or closed), or when kWindow records are held behind it. A
+// later copy must match the first one on (sequence, ts_recv, order_id,
+// action), otherwise the line is fenced: its new records are dropped until
+// one of its copies matches again. A fenced line is let back in once it is
+// the only line left open.
+class FeedArbiter {
+public:
+    static constexpr std::size_t kWindow = 1 << 16; // records remembered / held back
+
+    explicit FeedArbiter(std::size_t lines);
+
+    // `msgs` are the records of `line` from sequence `first_seq` on, received
+    // at `arrival_ns`. Returns the records that are now in order and were not
+    // applied yet (any line's); the caller applies exactly those. Valid until
+    // the next call.
+    std::span<const databento::MboMsg> on_records(std::size_t line, std::uint64_t first_seq,
+                                                  std::span<const databento::MboMsg> msgs,
+                                                  std::uint64_t arrival_ns);
+    // `line` reached EOF: gaps only it could fill are skipped, a fenced line
+    // left alone is let back in. Returns what that releases, as on_records.
+    std::span<const databento::MboMsg> on_line_closed(std::size_t line);
+
+    std::uint64_t applied() const { return applied_; }
+
+    void print_stats(const std::vector<std::string>& line_names);
+
+private:
+    static constexpr std::uint64_t kNoSeq = ~std::uint64_t{0};
+
+    struct Seen {
+        std::uint64_t seq = kNoSeq; // line sequence this slot holds
+        std::uint64_t ts_recv = 0;
+        std::uint64_t order_id = 0;
+        std::uint64_t arrival_ns = 0;
+        std::uint32_t sequence = 0;
+        char action = 0;
+    };
+
+    struct LineStats {
+        std::uint64_t next = 0;      // sequence after the last record delivered
+        std::uint64_t delivered = 0; // records delivered by this line
+        std::uint64_t wins = 0;      // ... that were first
+        std::uint64_t lost = 0;      // sequence gaps on this line
+        std::uint64_t divergent = 0; // copies not matching the first one
+        std::uint64_t dropped = 0;   // first copies dropped while fenced
+        std::uint64_t late = 0;      // copies older than kWindow or of a skipped gap
+        bool fenced = false;
+        bool closed = false;
+        std::vector<std::uint64_t> lag_ns; // late copy arrival - first arrival
+    };
+
+    static bool same(const Seen& seen, const databento::MboMsg& m);
+    // another line is open and not fenced
+    bool has_other_line(std::size_t line) const;
+    // no open, unfenced line can still deliver sequence next_
+    bool gap_lost() const;
+    // applies (or skips, if missing) the record at next_
+    void advance();
+    // applies held records up to the first gap some line can still fill
+    void release();
+
+    std::vector<Seen> ring_;
+    std::vector<LineStats> lines_;
+    std::deque<std::optional<databento::MboMsg>> held_; // held_[k] is sequence next_ + k
+    std::vector<databento::MboMsg> out_;
+    std::uint64_t next_ = 0;    // next sequence to apply
+    std::uint64_t applied_ = 0;
+    std::uint64_t skipped_ = 0; // sequences no line delivered in time
+};
@@ -1,50 +1,130 @@
 #include <iostream>
+#include <optional>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
+#include "bars.hpp"
 #include "config.hpp"
+#include "dbn_index.hpp"
 #include "dbn_reader.hpp"
 #include "order_book.hpp"
 #include "net.hpp"
+#include "signals.hpp"
+#include "trace.hpp"
+
+// Seek to the closest point before --start from which the book can be
+// rebuilt and stop at --end. Records before --start are still needed to
+// warm the book up, callers skip their output.
+static void position_reader(DbnReader& reader, const Options& opts) {
+    if (opts.start_ns) {
+        auto index = load_or_build_dbn_index(opts.dbn_path, opts.index_every,
+                                             opts.index_interval_ns);
+        auto safe = index.safe_point_before(*opts.start_ns);
+        reader.seek(safe.byte_offset);
+        std::cerr << "Starting at record " << safe.record_count
+                  << " (offset " << safe.byte_offset << ")\n";
+    }
+    if (opts.end_ns) {
+        reader.set_end(*opts.end_ns);
+    }
+}
 
 int main(int argc, char** argv) {
     try {
         // 1) Parse CLI args into a simple Options struct
         Options opts = parse_options(argc, argv);
+        if (!opts.trace_path.empty()) {
+            trace::enable(opts.trace_path);
+        }
 
         switch (opts.mode) {
             case Mode::Replay: {
                 // DBN -> OrderBook -> JSON snapshot
                 DbnReader reader{opts.dbn_path};
-                OrderBook book;
+                position_reader(reader, opts);
+                OrderBook book{opts.book_mode};
+                BarAggregator bars{opts.bar_intervals_ns};
+                std::vector<databento::MboMsg> batch;
+                batch.reserve(opts.batch);
 
-                while (auto ev = reader.next()) {
-                    book.on_event(*ev);
+                while (true) {
+                    std::optional<databento::MboMsg> ev;
+                    {
+                        MBO_TRACE_SPAN("decode");
+                        ev = reader.next();
+                    }
+                    if (!ev) break;
+                    MBO_TRACE_POLL();
+                    if (opts.start_ns &&
+                        ev->ts_recv.time_since_epoch().count() < *opts.start_ns) {
+                        book.catch_up(*ev);
+                        continue;
+                    }
+                    bars.on_event(*ev);
+                    if (opts.batch <= 1) {
+                        book.on_event(*ev);
+                        continue;
+                    }
+                    batch.push_back(*ev);
+                    if (batch.size() == opts.batch) {
+                        book.on_batch(batch);
+                        batch.clear();
+                    }
                 }
+                book.on_batch(batch);
+                book.flush_snapshot();
 
-                book.write_snapshot_json(opts.output_path);
+                json extra = json::object();
+                if (bars.enabled()) {
+                    bars.flush();
+                    extra["bars"] = bars_to_json(bars.take_closed());
+                    extra["last_trades"] = bars.last_trades_json();
+                }
+                if (opts.signal_kernel != SignalKernel::Off) {
+                    TopOfBook top;
+                    book.top_of_book(top, opts.signal_levels);
+                    extra["signals"] = signals_to_json(
+                        compute_signals(opts.signal_kernel, top, opts.signal_depth_px));
+                }
+                book.write_snapshot_json(opts.output_path, extra);
                 book.print_latency_stats();
+                book.print_load_stats();
                 break;
             }
 
             case Mode::Streamer: {
                 // DBN -> TCP stream (line-based protocol), rate-limited
                 DbnReader reader{opts.dbn_path};
+                position_reader(reader, opts);
                 run_streamer(reader, opts); // implement in net.cpp
                 break;
             }
 
             case Mode::Engine: {
                 // TCP client -> OrderBook -> metrics + JSON snapshot
-                OrderBook book;
+                OrderBook book{opts.book_mode};
                 run_engine(book, opts); // implement in net.cpp
                 break;
             }
 
+            case Mode::Index: {
+                // DBN -> sidecar index (<dbn>.idx)
+                auto index = build_dbn_index(opts.dbn_path, opts.index_every,
+                                             opts.index_interval_ns);
+                write_dbn_index(index, dbn_index_path(opts.dbn_path));
+                std::cerr << "Wrote DBN index to " << dbn_index_path(opts.dbn_path)
+                          << " (" << index.checkpoints.size() << " checkpoints, "
+                          << index.clears.size() << " clears, "
+                          << index.snapshots.size() << " snapshots)\n";
+                break;
+            }
+
             default:
                 std::cerr << "Unknown mode\n";
                 return 1;
         }
+        trace::dump();
     } catch (const std::exception& ex) {
         std::cerr << "Fatal error: " << ex.what() << "\n";
         return 1;
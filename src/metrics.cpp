@@ -0,0 +1,179 @@
+#include "metrics.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+std::uint64_t bucket_upper_ns(std::size_t idx) {
+    return std::uint64_t{1} << (idx + 6);
+}
+
+} // namespace
+
+void Metrics::record_latency_ns(std::uint64_t ns) {
+    std::size_t idx = ns <= 1 ? 0 : static_cast<std::size_t>(std::bit_width(ns - 1));
+    idx = idx <= 6 ? 0 : std::min(idx - 6, kLatencyBuckets - 1);
+    inc(latency_buckets_[idx]);
+    latency_sum_ns_.store(latency_sum_ns_.load(std::memory_order_relaxed) + ns,
+                          std::memory_order_relaxed);
+}
+
+std::string Metrics::to_prometheus() const {
+    auto load = [](const auto& a) { return a.load(std::memory_order_relaxed); };
+    std::ostringstream out;
+
+    out << "# TYPE mbo_messages_received_total counter\n"
+        << "mbo_messages_received_total " << load(received_) << "\n"
+        << "# TYPE mbo_messages_applied_total counter\n"
+        << "mbo_messages_applied_total " << load(applied_) << "\n"
+        << "# TYPE mbo_errors_total counter\n";
+    for (std::size_t i = 1; i < errors_.size(); ++i) { // [0] is BookError::None
+        out << "mbo_errors_total{reason=\"" << to_string(static_cast<BookError>(i)) << "\"} "
+            << load(errors_[i]) << "\n";
+    }
+
+    out << "# TYPE mbo_book_levels gauge\n"
+        << "mbo_book_levels{side=\"bid\"} " << load(bid_levels_) << "\n"
+        << "mbo_book_levels{side=\"ask\"} " << load(ask_levels_) << "\n"
+        << "# TYPE mbo_live_orders gauge\n"
+        << "mbo_live_orders " << load(live_orders_) << "\n"
+        << "# TYPE mbo_socket_queue_bytes gauge\n"
+        << "mbo_socket_queue_bytes " << load(socket_queue_bytes_) << "\n"
+        << "# TYPE mbo_time_to_valid_book_ns gauge\n"
+        << "mbo_time_to_valid_book_ns " << load(time_to_valid_book_ns_) << "\n";
+
+    // Buckets are read one by one while the writer keeps going, so the
+    // count is taken from the same pass to keep the histogram consistent
+    std::array<std::uint64_t, kLatencyBuckets> buckets;
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < kLatencyBuckets; ++i) {
+        buckets[i] = load(latency_buckets_[i]);
+        total += buckets[i];
+    }
+
+    out << "# TYPE mbo_apply_latency_ns histogram\n";
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i + 1 < kLatencyBuckets; ++i) {
+        cumulative += buckets[i];
+        out << "mbo_apply_latency_ns_bucket{le=\"" << bucket_upper_ns(i) << "\"} "
+            << cumulative << "\n";
+    }
+    out << "mbo_apply_latency_ns_bucket{le=\"+Inf\"} " << total << "\n"
+        << "mbo_apply_latency_ns_sum " << load(latency_sum_ns_) << "\n"
+        << "mbo_apply_latency_ns_count " << total << "\n";
+
+    // Bucket upper bounds, good enough to spot a tail blowing up
+    out << "# TYPE mbo_apply_latency_quantile_ns gauge\n";
+    for (double q : {0.5, 0.9, 0.99, 0.999}) {
+        std::uint64_t value = 0;
+        if (total > 0) {
+            const auto rank = static_cast<std::uint64_t>(q * static_cast<double>(total));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < kLatencyBuckets; ++i) {
+                seen += buckets[i];
+                if (seen > rank) {
+                    value = bucket_upper_ns(i);
+                    break;
+                }
+            }
+        }
+        out << "mbo_apply_latency_quantile_ns{quantile=\"" << q << "\"} " << value << "\n";
+    }
+
+    return out.str();
+}
+
+MetricsServer::MetricsServer(const Metrics& metrics, int port, std::optional<int> avoid_cpu)
+    : metrics_(metrics) {
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) throw std::runtime_error("socket() failed");
+
+    int opt = 1;
+    ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    // local only, this is a debugging surface
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd_, 8) < 0) {
+        ::close(listen_fd_);
+        throw std::runtime_error("Failed to listen for metrics on port " + std::to_string(port));
+    }
+
+    thread_ = std::thread([this] { serve(); });
+    if (avoid_cpu) {
+        // the creating thread's mask, minus the apply core
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (::sched_getaffinity(0, sizeof(set), &set) == 0 && *avoid_cpu >= 0 &&
+            *avoid_cpu < CPU_SETSIZE) {
+            CPU_CLR(*avoid_cpu, &set);
+            if (CPU_COUNT(&set) > 0) {
+                ::pthread_setaffinity_np(thread_.native_handle(), sizeof(set), &set);
+            }
+        }
+    }
+    std::cerr << "Metrics on http://127.0.0.1:" << port << "/metrics\n";
+}
+
+MetricsServer::~MetricsServer() {
+    stop_.store(true);
+    if (thread_.joinable()) thread_.join();
+    ::close(listen_fd_);
+}
+
+void MetricsServer::serve() {
+    while (!stop_.load()) {
+        pollfd pfd{listen_fd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 200) <= 0) continue;
+
+        int client = ::accept(listen_fd_, nullptr, nullptr);
+        if (client < 0) continue;
+
+        // Only the request line matters, don't wait forever for it
+        char req[1024];
+        ssize_t n = 0;
+        pollfd cpfd{client, POLLIN, 0};
+        if (::poll(&cpfd, 1, 1000) > 0) {
+            n = ::recv(client, req, sizeof(req), 0);
+        }
+
+        std::string response;
+        std::string_view request{req, n > 0 ? static_cast<std::size_t>(n) : 0};
+        if (request.rfind("GET /metrics", 0) == 0) {
+            std::string body = metrics_.to_prometheus();
+            response = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                       "Connection: close\r\n\r\n" + body;
+        } else {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+
+        const char* p = response.data();
+        std::size_t left = response.size();
+        while (left > 0) {
+            ssize_t sent = ::send(client, p, left, MSG_NOSIGNAL);
+            if (sent <= 0) break;
+            p += sent;
+            left -= static_cast<std::size_t>(sent);
+        }
+        ::close(client);
+    }
+}
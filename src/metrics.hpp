@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "book_error.hpp"
+
+// Live engine metrics. Written by the apply thread with relaxed atomics
+// (single writer, no locks), read by MetricsServer from its own thread.
+class Metrics {
+public:
+    static constexpr std::size_t kLatencyBuckets = 24; // 2^6 ns .. 2^29 ns
+
+    void on_received(std::uint64_t n = 1) {
+        received_.store(received_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void on_applied(std::uint64_t n = 1) {
+        applied_.store(applied_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void on_error(BookError reason) { inc(errors_[static_cast<std::size_t>(reason)]); }
+
+    void set_book_depth(std::uint32_t bid_levels, std::uint32_t ask_levels) {
+        bid_levels_.store(bid_levels, std::memory_order_relaxed);
+        ask_levels_.store(ask_levels, std::memory_order_relaxed);
+    }
+    void set_live_orders(std::uint64_t n) { live_orders_.store(n, std::memory_order_relaxed); }
+    void set_socket_queue_bytes(std::uint64_t n) { socket_queue_bytes_.store(n, std::memory_order_relaxed); }
+    void set_time_to_valid_book_ns(std::uint64_t ns) { time_to_valid_book_ns_.store(ns, std::memory_order_relaxed); }
+
+    void record_latency_ns(std::uint64_t ns);
+
+    // Prometheus text exposition format
+    std::string to_prometheus() const;
+
+private:
+    // Only one thread writes, so load + store is enough and avoids a locked RMW
+    static void inc(std::atomic<std::uint64_t>& c) {
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    alignas(64) std::atomic<std::uint64_t> received_{0};
+    std::atomic<std::uint64_t> applied_{0};
+    std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(BookError::Count_)> errors_{};
+
+    std::atomic<std::uint32_t> bid_levels_{0};
+    std::atomic<std::uint32_t> ask_levels_{0};
+    std::atomic<std::uint64_t> live_orders_{0};
+    std::atomic<std::uint64_t> socket_queue_bytes_{0};
+    std::atomic<std::uint64_t> time_to_valid_book_ns_{0};
+
+    alignas(64) std::array<std::atomic<std::uint64_t>, kLatencyBuckets> latency_buckets_{};
+    std::atomic<std::uint64_t> latency_sum_ns_{0};
+};
+
+// Serves GET /metrics on 127.0.0.1:port from a background thread, which
+// never runs on `avoid_cpu` (the pinned apply thread's core)
+class MetricsServer {
+public:
+    MetricsServer(const Metrics& metrics, int port, std::optional<int> avoid_cpu = std::nullopt);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+private:
+    void serve();
+
+    const Metrics& metrics_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
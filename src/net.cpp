@@ -1,20 +1,35 @@
 #include "net.hpp"
+#include "bars.hpp"
 #include "dbn_reader.hpp"
+#include "feed_arbiter.hpp"
 #include "order_book.hpp"
+#include "runtime.hpp"
+#include "signals.hpp"
+#include "trace.hpp"
 
 #include <databento/record.hpp>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <chrono>
 #include <cstring>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <random>
 #include <stdexcept>
 #include <thread>
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <span>
+#include <sstream>
 
 using databento::MboMsg;
 
@@ -80,19 +95,138 @@ void send_all(int fd, const void* buf, std::size_t len) {
     }
 }
 
-std::size_t recv_all(int fd, void* buf, std::size_t len) {
+// recv() that spins on a non-blocking socket until data or EOF arrives
+ssize_t recv_some(int fd, void* buf, std::size_t len, SpinStats* spin) {
+    while (true) {
+        ssize_t n = ::recv(fd, buf, len, 0);
+        if (n >= 0) {
+            if (spin) spin->on_data();
+            return n;
+        }
+        if (errno == EINTR) continue;
+        if (spin && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            spin->on_empty_poll();
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            continue;
+        }
+        throw std::runtime_error("recv() failed");
+    }
+}
+
+std::size_t recv_all(int fd, void* buf, std::size_t len, SpinStats* spin = nullptr) {
+    MBO_TRACE_SPAN("recv");
     char* p = static_cast<char*>(buf);
     std::size_t total = 0;
     while (total < len) {
-        ssize_t n = ::recv(fd, p + total, len - total, 0);
-        if (n < 0) throw std::runtime_error("recv() failed");
+        ssize_t n = recv_some(fd, p + total, len - total, spin);
         if (n == 0) break; // EOF
         total += static_cast<std::size_t>(n);
     }
     return total;
 }
 
+// --wire-ts framing: every streamer batch is preceded by this header. Both
+// sides read steady_clock (CLOCK_MONOTONIC), so on one host send_ns is
+// directly comparable with the engine's receive time. first_seq numbers the
+// streamer's records densely from 0, dropped batches included, so A/B lines
+// can be aligned and their gaps seen.
+struct FrameHeader {
+    std::uint32_t magic;
+    std::uint32_t count;        // MboMsg records that follow
+    std::uint64_t send_ns;      // steady_clock right before send()
+    std::uint64_t offered_rate; // streamer msgs/sec for this batch, 0 = unthrottled
+    std::uint64_t first_seq;    // line sequence of the first record
+};
+constexpr std::uint32_t kFrameMagic = 0x4D424F46; // "FOBM"
+constexpr std::uint32_t kMaxFrameRecords = 1 << 20;
+
+std::uint64_t steady_now_ns() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Receive buffer for the batched engine path
+struct RecvBuffer {
+    std::vector<MboMsg> msgs;
+    std::size_t complete = 0; // messages returned by the last recv
+    std::size_t partial = 0;  // bytes of the following message already read
+};
+
+// A single recv() for whatever is available, up to msgs.size() messages.
+// complete stays 0 when only part of a message came in; the partial
+// message is kept and completed by the next call. Returns false on EOF.
+bool recv_once(int fd, RecvBuffer& rb, SpinStats* spin = nullptr) {
+    MBO_TRACE_SPAN("recv");
+    constexpr std::size_t MSG_SIZE = sizeof(MboMsg);
+    char* base = reinterpret_cast<char*>(rb.msgs.data());
+    const std::size_t capacity = rb.msgs.size() * MSG_SIZE;
+
+    std::memmove(base, base + rb.complete * MSG_SIZE, rb.partial);
+    rb.complete = 0;
+
+    ssize_t n = recv_some(fd, base + rb.partial, capacity - rb.partial, spin);
+    if (n == 0) return false; // EOF, a trailing partial message is dropped
+    rb.partial += static_cast<std::size_t>(n);
+    rb.complete = rb.partial / MSG_SIZE;
+    rb.partial -= rb.complete * MSG_SIZE;
+    return true;
+}
+
+// recv_once() until at least one whole message is in. Returns 0 on EOF.
+std::size_t recv_batch(int fd, RecvBuffer& rb, SpinStats* spin = nullptr) {
+    do {
+        if (!recv_once(fd, rb, spin)) return 0;
+    } while (rb.complete == 0);
+    return rb.complete;
+}
+
+// Receive buffer for --wire-ts frames on a polled line: a frame may take
+// several recv() calls, and a line must not block the others meanwhile
+struct FrameBuffer {
+    std::vector<char> bytes = std::vector<char>(1 << 20);
+    std::size_t begin = 0; // first byte not yet taken by next_frame()
+    std::size_t end = 0;   // bytes received
+    FrameHeader hdr{};
+    std::vector<MboMsg> msgs; // records of the last frame taken
+};
+
+// A single recv() for whatever is available. Returns false on EOF.
+bool recv_frames(int fd, FrameBuffer& fb, SpinStats* spin = nullptr) {
+    MBO_TRACE_SPAN("recv");
+    if (fb.begin > 0) {
+        std::memmove(fb.bytes.data(), fb.bytes.data() + fb.begin, fb.end - fb.begin);
+        fb.end -= fb.begin;
+        fb.begin = 0;
+    }
+    if (fb.end == fb.bytes.size()) fb.bytes.resize(2 * fb.bytes.size()); // frame larger than the buffer
+
+    ssize_t n = recv_some(fd, fb.bytes.data() + fb.end, fb.bytes.size() - fb.end, spin);
+    if (n == 0) return false; // EOF, a trailing partial frame is dropped
+    fb.end += static_cast<std::size_t>(n);
+    return true;
+}
+
+// Takes the next whole frame out of the buffer into hdr / msgs, if there is one
+bool next_frame(FrameBuffer& fb) {
+    const std::size_t available = fb.end - fb.begin;
+    if (available < sizeof(FrameHeader)) return false;
+    std::memcpy(&fb.hdr, fb.bytes.data() + fb.begin, sizeof(FrameHeader));
+    if (fb.hdr.magic != kFrameMagic || fb.hdr.count > kMaxFrameRecords) {
+        throw std::runtime_error("Bad frame header, is the streamer running with --wire-ts?");
+    }
+    const std::size_t bytes = fb.hdr.count * sizeof(MboMsg);
+    if (available < sizeof(FrameHeader) + bytes) return false;
+    fb.msgs.resize(fb.hdr.count);
+    std::memcpy(fb.msgs.data(), fb.bytes.data() + fb.begin + sizeof(FrameHeader), bytes);
+    fb.begin += sizeof(FrameHeader) + bytes;
+    return true;
+}
+
 void run_streamer(DbnReader& reader, const Options& opts) {
+    using Clock = std::chrono::steady_clock;
+
     int listen_fd = create_listen_socket(opts.port);
     std::cout << "Streamer listening on port " << opts.port << "...\n";
     int client_fd = accept_one_client(listen_fd);
@@ -105,43 +239,125 @@ void run_streamer(DbnReader& reader, const Options& opts) {
     std::vector<MboMsg> batch;
     batch.reserve(batch_size);
 
-    std::uint64_t sent = 0;
-    auto start = std::chrono::steady_clock::now();
+    // --rate-steps: offered rate goes up every --step-records records, the
+    // last step runs to the end
+    std::size_t step = 0;
+    std::uint64_t rate = opts.rate_steps.empty() ? opts.rate : opts.rate_steps.front();
+
+    // --delay-us / --jitter-us: batches wait in a delay line until they are
+    // due. Due times never go backwards, the line stays in order like a
+    // real one; --loss-pct drops whole batches, like lost packets. Seeded by
+    // port so a run is repeatable.
+    struct Held {
+        Clock::time_point due;
+        std::uint64_t rate;
+        std::uint64_t first_seq;
+        std::vector<MboMsg> msgs;
+    };
+    const bool delayed = opts.delay_us > 0 || opts.jitter_us > 0;
+    std::mt19937_64 rng{static_cast<std::uint64_t>(opts.port)};
+    std::uniform_int_distribution<std::uint64_t> jitter{0, opts.jitter_us};
+    std::uniform_real_distribution<double> loss{0.0, 100.0};
+    std::uint64_t dropped = 0;
+    std::deque<Held> in_flight;
+    Clock::time_point last_due{};
+
+    std::vector<char> frame; // --wire-ts: header + batch in one send()
+    auto send_batch = [&](const std::vector<MboMsg>& b, std::uint64_t offered_rate,
+                          std::uint64_t first_seq) {
+        MBO_TRACE_SPAN("send");
+        const char* data = reinterpret_cast<const char*>(b.data());
+        const std::size_t bytes = b.size() * MSG_SIZE;
+        if (!opts.wire_ts) {
+            send_all(client_fd, data, bytes);
+            return;
+        }
+        const FrameHeader hdr{kFrameMagic, static_cast<std::uint32_t>(b.size()),
+                              steady_now_ns(), offered_rate, first_seq};
+        frame.resize(sizeof(hdr) + bytes);
+        std::memcpy(frame.data(), &hdr, sizeof(hdr));
+        std::memcpy(frame.data() + sizeof(hdr), data, bytes);
+        send_all(client_fd, frame.data(), frame.size());
+    };
+    // sends every held batch that is due by `until`
+    auto drain_until = [&](Clock::time_point until) {
+        while (!in_flight.empty() && in_flight.front().due <= until) {
+            std::this_thread::sleep_until(in_flight.front().due);
+            send_batch(in_flight.front().msgs, in_flight.front().rate, in_flight.front().first_seq);
+            in_flight.pop_front();
+        }
+    };
+    std::uint64_t sent = 0; // records read so far, the sequence of the next batch
+    auto emit = [&](std::vector<MboMsg>& b) {
+        if (opts.loss_pct > 0 && loss(rng) < opts.loss_pct) {
+            dropped += b.size();
+            return;
+        }
+        if (!delayed) {
+            send_batch(b, rate, sent);
+            return;
+        }
+        auto now = Clock::now();
+        auto due = now + std::chrono::microseconds(opts.delay_us + jitter(rng));
+        last_due = std::max(last_due, due);
+        in_flight.push_back(Held{last_due, rate, sent, b});
+        drain_until(now);
+    };
+
+    std::uint64_t step_sent = 0;
+    auto start = Clock::now();
 
-    while (auto msg = reader.next()) {
+    while (true) {
+        std::optional<MboMsg> msg;
+        {
+            MBO_TRACE_SPAN("decode");
+            msg = reader.next();
+        }
+        if (!msg) break;
         batch.push_back(*msg);
+        MBO_TRACE_POLL();
 
         if (batch.size() == batch_size) {
-            const char* data = reinterpret_cast<const char*>(batch.data());
-            std::size_t bytes = batch.size() * MSG_SIZE;
-            send_all(client_fd, data, bytes);
+            emit(batch);
             sent += batch.size();
+            step_sent += batch.size();
             batch.clear();
 
-            // crude rate limiting to opts.rate msgs/sec
-            if (opts.rate > 0) {
-                auto now = std::chrono::steady_clock::now();
+            // crude rate limiting to `rate` msgs/sec
+            if (rate > 0) {
+                auto now = Clock::now();
                 double elapsed = std::chrono::duration<double>(now - start).count();
-                double ideal = static_cast<double>(sent) / static_cast<double>(opts.rate);
+                double ideal = static_cast<double>(step_sent) / static_cast<double>(rate);
                 if (elapsed < ideal) {
-                    auto sleep_for = std::chrono::duration<double>(ideal - elapsed);
-                    std::this_thread::sleep_for(sleep_for);
+                    auto wake = now + std::chrono::duration_cast<Clock::duration>(
+                                          std::chrono::duration<double>(ideal - elapsed));
+                    drain_until(wake);
+                    std::this_thread::sleep_until(wake);
                 }
             }
+
+            if (step + 1 < opts.rate_steps.size() && step_sent >= opts.step_records) {
+                rate = opts.rate_steps[++step];
+                step_sent = 0;
+                start = Clock::now();
+                std::cout << "Offered rate " << (rate ? std::to_string(rate) + " msg/s" : "unthrottled")
+                          << " from message " << sent << "\n";
+            }
         }
     }
 
     if (!batch.empty()) {
-        const char* data = reinterpret_cast<const char*>(batch.data());
-        std::size_t bytes = batch.size() * MSG_SIZE;
-        send_all(client_fd, data, bytes);
+        emit(batch);
         sent += batch.size();
     }
+    drain_until(Clock::time_point::max());
 
     ::close(client_fd);
     ::close(listen_fd);
 
-    std::cout << "Streamer finished sending " << sent << " messages\n";
+    std::cout << "Streamer finished sending " << sent - dropped << " messages";
+    if (dropped) std::cout << " (dropped " << dropped << ")";
+    std::cout << "\n";
 }
 
 static void write_snapshot_to_file(json j, std::string path, std::optional<int> snapshot_id) {
@@ -153,6 +369,7 @@ static void write_snapshot_to_file(json j, std::string path, std::optional<int>
         path = base + "_" + std::to_string(*snapshot_id) + ext;
     }
 
+    MBO_TRACE_SPAN("serialize");
     std::ofstream out(path);
     if (out.fail()) {
         throw std::runtime_error("Failed to open output file: " + path);
@@ -161,9 +378,90 @@ static void write_snapshot_to_file(json j, std::string path, std::optional<int>
     std::cerr << "Wrote order book snapshot to " << path << "\n";
 }
 
+// --wire-ts results for one offered rate. send->recv is per frame,
+// recv->applied and applied->published per published snapshot.
+struct WireStats {
+    std::vector<std::uint64_t> send_recv_ns;
+    std::vector<std::uint64_t> recv_applied_ns;
+    std::vector<std::uint64_t> applied_published_ns;
+    std::uint64_t messages = 0;
+    std::uint64_t first_recv_ns = 0;
+    std::uint64_t last_recv_ns = 0;
+};
+
+static void print_wire_stats(std::map<std::uint64_t, WireStats>& by_rate) {
+    if (by_rate.empty()) return;
+    auto stage = [](std::vector<std::uint64_t>& ns) {
+        if (ns.empty()) return std::string("-");
+        std::sort(ns.begin(), ns.end());
+        auto at = [&](double p) { return ns[static_cast<std::size_t>(p * (ns.size() - 1))] / 1000.0; };
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << at(0.50) << " / " << at(0.99);
+        return out.str();
+    };
+
+    std::cerr << "== Wire-to-book latency (us, p50 / p99) ==\n";
+    std::cerr << std::setw(12) << "offered/s" << std::setw(12) << "achieved/s"
+              << std::setw(20) << "send->recv" << std::setw(20) << "recv->applied"
+              << std::setw(22) << "applied->published" << "\n";
+    // ascending offered rate, unthrottled (0) last
+    std::vector<std::pair<const std::uint64_t, WireStats>*> rows;
+    for (auto& row : by_rate) rows.push_back(&row);
+    std::stable_partition(rows.begin(), rows.end(), [](auto* row) { return row->first != 0; });
+
+    std::optional<std::uint64_t> saturated;
+    for (auto* row : rows) {
+        const std::uint64_t rate = row->first;
+        WireStats& w = row->second;
+        const double span_s = static_cast<double>(w.last_recv_ns - w.first_recv_ns) / 1e9;
+        const double achieved = span_s > 0 ? static_cast<double>(w.messages) / span_s : 0.0;
+        if (rate > 0 && achieved > 0 && achieved < 0.95 * static_cast<double>(rate) && !saturated) {
+            saturated = rate;
+        }
+        std::cerr << std::setw(12) << (rate ? std::to_string(rate) : "max")
+                  << std::setw(12) << static_cast<std::uint64_t>(achieved)
+                  << std::setw(20) << stage(w.send_recv_ns)
+                  << std::setw(20) << stage(w.recv_applied_ns)
+                  << std::setw(22) << stage(w.applied_published_ns) << "\n";
+    }
+    if (saturated) {
+        std::cerr << "Saturated at " << *saturated << " msg/s (achieved < 95% of offered)\n";
+    }
+}
+
 void run_engine(OrderBook& book, const Options& opts) {
-    int sock = connect_to_server(opts.host, opts.port);
-    std::cout << "Engine connected to " << opts.host << ":" << opts.port << "\n";
+    // Started before --cpu pins this thread, so the HTTP thread doesn't
+    // inherit the pinning; it is kept off that core
+    Metrics metrics;
+    std::unique_ptr<MetricsServer> metrics_server;
+    if (opts.metrics_port) {
+        book.set_metrics(&metrics);
+        metrics_server = std::make_unique<MetricsServer>(
+            metrics, *opts.metrics_port, opts.low_latency ? opts.cpu : std::nullopt);
+    }
+
+    std::optional<SpinStats> spin;
+    if (opts.low_latency) {
+        apply_low_latency_profile(opts);
+        spin.emplace();
+    }
+
+    std::vector<FeedEndpoint> feeds = opts.feeds;
+    if (feeds.empty()) feeds.push_back(FeedEndpoint{opts.host, opts.port});
+
+    std::vector<int> socks;
+    std::vector<std::string> feed_names;
+    for (const auto& feed : feeds) {
+        int sock = connect_to_server(feed.host, feed.port);
+        feed_names.push_back(feed.host + ":" + std::to_string(feed.port));
+        std::cout << "Engine connected to " << feed_names.back() << "\n";
+        if (opts.low_latency) {
+            tune_socket_low_latency(sock);
+        }
+        socks.push_back(sock);
+    }
+    SpinStats* spin_stats = spin ? &*spin : nullptr;
+    const RuntimeSample runtime_before = sample_runtime();
 
     constexpr std::size_t MSG_SIZE = sizeof(MboMsg);
 
@@ -173,22 +471,57 @@ void run_engine(OrderBook& book, const Options& opts) {
     std::vector<double> latencies_us;
     latencies_us.reserve(1'000'000);
 
-    MboMsg msg{}; 
-
     json whole_feed_json = json::array();
+    BarAggregator bars{opts.bar_intervals_ns};
+
+    // Per-stage cost: signals are compared against the snapshot build
+    TopOfBook top;
+    std::vector<std::uint64_t> snapshot_ns;
+    std::vector<std::uint64_t> top_fill_ns;
+    std::vector<std::uint64_t> signals_ns;
+    snapshot_ns.reserve(1'000'000);
+    if (opts.signal_kernel != SignalKernel::Off) {
+        top_fill_ns.reserve(1'000'000);
+        signals_ns.reserve(1'000'000);
+    }
 
-    while (true) {
-        std::size_t n = recv_all(sock, &msg, MSG_SIZE);
-        if (n == 0) break;        // EOF
-        if (n < MSG_SIZE) break;  // truncated / error
-
-        // Measuring latency between A and B
-        // A: Message received
-        auto t0 = std::chrono::steady_clock::now();
-
-        book.on_event(msg); 
-        auto snapshot = book.snapshot(opts.order_book_levels.value_or(5));
-        snapshot["ts"] = msg.ts_recv.time_since_epoch().count();
+    bool done = false;
+    bool live = !opts.start_ns;     // past the --start warmup
+    std::uint64_t published = 0;    // snapshots so far
+    std::uint64_t applied_ns = 0;   // --wire-ts: when the last one was applied ...
+    std::uint64_t published_ns = 0; // ... and published
+    std::map<std::uint64_t, WireStats> wire_by_rate;
+    std::int64_t last_ts = 0;       // ts_recv of the last message after --start
+
+    // Builds and publishes one snapshot of the current book; t0 is when the
+    // messages it covers were received
+    auto publish = [&](std::int64_t ts, std::chrono::steady_clock::time_point t0) {
+        auto ts0 = std::chrono::steady_clock::now();
+        json snapshot;
+        {
+            MBO_TRACE_SPAN("snapshot");
+            snapshot = book.snapshot(opts.order_book_levels.value_or(5));
+            snapshot["ts"] = ts;
+        }
+        auto ts1 = std::chrono::steady_clock::now();
+        snapshot_ns.push_back(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(ts1 - ts0).count()));
+
+        if (opts.signal_kernel != SignalKernel::Off) {
+            MBO_TRACE_SPAN("signals");
+            book.top_of_book(top, opts.signal_levels);
+            auto ts2 = std::chrono::steady_clock::now();
+            auto signals = compute_signals(opts.signal_kernel, top, opts.signal_depth_px);
+            auto ts3 = std::chrono::steady_clock::now();
+            snapshot["signals"] = signals_to_json(signals);
+            top_fill_ns.push_back(static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(ts2 - ts1).count()));
+            signals_ns.push_back(static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(ts3 - ts2).count()));
+        }
+        if (auto closed = bars.take_closed(); !closed.empty()) {
+            snapshot["bars"] = bars_to_json(closed);
+        }
 
         // B: Snapshot generated and ready to be serialized
         auto t1 = std::chrono::steady_clock::now();
@@ -199,11 +532,178 @@ void run_engine(OrderBook& book, const Options& opts) {
         // here the snapshot can be optionally written to file / logged / streamed to a DB
         // write_snapshot_to_file(snapshot, opts.output_path, msg.ts_recv.time_since_epoch().count());
 
-        ++received;
+        if (opts.wire_ts) {
+            applied_ns = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(ts0.time_since_epoch()).count());
+            published_ns = steady_now_ns();
+        }
+        ++published;
+    };
+
+    // Applies one received chunk and publishes one snapshot for it (none while
+    // a snapshot run is held back)
+    auto process = [&](std::span<const MboMsg> msgs) {
+        // Keep only the part inside [--start, --end)
+        std::size_t first = 0;
+        std::size_t last = msgs.size();
+        for (std::size_t i = 0; i < msgs.size(); ++i) {
+            const auto ts = msgs[i].ts_recv.time_since_epoch().count();
+            if (opts.end_ns && ts >= *opts.end_ns) {
+                last = i;
+                done = true;
+                break;
+            }
+            if (opts.start_ns && ts < *opts.start_ns) {
+                // streamer starts at a safe point, warm the book up to --start
+                book.catch_up(msgs[i]);
+                first = i + 1;
+            }
+        }
+        MBO_TRACE_POLL();
+        if (first >= last) return;
+        live = true;
+        auto window = msgs.subspan(first, last - first);
+
+        // Measuring latency between A and B
+        // A: Message (batch) received
+        auto t0 = std::chrono::steady_clock::now();
+
+        if (window.size() == 1) {
+            book.on_event(window.front());
+        } else {
+            book.on_batch(window);
+        }
+        for (const auto& m : window) {
+            bars.on_event(m);
+        }
+        // a snapshot run after Clear is still held back (the book is empty
+        // until it loads), publish once it is in
+        last_ts = window.back().ts_recv.time_since_epoch().count();
+        if (!book.holding_snapshot()) publish(last_ts, t0);
+        received += window.size();
+    };
+
+    auto on_received = [&](int sock, std::size_t count) {
+        metrics.on_received(count);
+        // pending bytes in the socket buffer, sampled to keep syscalls off the
+        // hot path; the backlog while warming up to --start is not the engine's
+        if (live && (received & 1023) < count) {
+            int pending = 0;
+            if (::ioctl(sock, FIONREAD, &pending) == 0) {
+                metrics.set_socket_queue_bytes(static_cast<std::uint64_t>(pending));
+            }
+        }
+    };
+
+    // Applies records that came in with --wire-ts frame `hdr` at recv_ns, with
+    // the same snapshot granularity as without framing: per message or per --batch
+    auto apply_frame = [&](int sock, const FrameHeader& hdr, std::span<const MboMsg> msgs,
+                           std::uint64_t recv_ns) {
+        if (metrics_server) on_received(sock, msgs.size());
+
+        WireStats& w = wire_by_rate[hdr.offered_rate];
+        if (w.messages == 0) w.first_recv_ns = recv_ns;
+        w.last_recv_ns = recv_ns;
+        w.messages += msgs.size();
+        w.send_recv_ns.push_back(recv_ns - std::min(recv_ns, hdr.send_ns));
+
+        for (std::size_t off = 0; off < msgs.size() && !done; off += opts.batch) {
+            const std::uint64_t before = published;
+            process(msgs.subspan(off, std::min(opts.batch, msgs.size() - off)));
+            if (published == before) continue;
+            w.recv_applied_ns.push_back(applied_ns - recv_ns);
+            w.applied_published_ns.push_back(published_ns - applied_ns);
+        }
+    };
+
+    std::optional<FeedArbiter> arbiter;
+    if (socks.size() > 1) {
+        // A/B lines (always --wire-ts): read whatever any line has, apply
+        // records in line sequence order, each once
+        arbiter.emplace(socks.size());
+        std::vector<pollfd> fds;
+        std::vector<FrameBuffer> lines(socks.size());
+        for (std::size_t i = 0; i < socks.size(); ++i) {
+            fds.push_back(pollfd{socks[i], POLLIN, 0});
+        }
+
+        std::size_t open = socks.size();
+        while (!done && open > 0) {
+            int ready = ::poll(fds.data(), fds.size(), spin_stats ? 0 : -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("poll() failed");
+            }
+            if (ready == 0) {
+                if (spin_stats) spin_stats->on_empty_poll();
+                continue;
+            }
+
+            for (std::size_t i = 0; i < fds.size() && !done; ++i) {
+                if (fds[i].fd < 0 || fds[i].revents == 0) continue;
+                if (!recv_frames(fds[i].fd, lines[i], spin_stats)) {
+                    fds[i].fd = -1; // poll() skips it from now on
+                    --open;
+                    // records held for a gap only this line could have filled
+                    auto released = arbiter->on_line_closed(i);
+                    for (std::size_t off = 0; off < released.size() && !done; off += opts.batch) {
+                        process(released.subspan(off, std::min(opts.batch, released.size() - off)));
+                    }
+                    continue;
+                }
+                while (!done && next_frame(lines[i])) {
+                    const FrameHeader& hdr = lines[i].hdr;
+                    const auto recv_ns = steady_now_ns();
+                    auto fresh = arbiter->on_records(i, hdr.first_seq, lines[i].msgs, recv_ns);
+                    if (!fresh.empty()) apply_frame(socks[i], hdr, fresh, recv_ns);
+                }
+            }
+        }
+    } else if (opts.wire_ts) {
+        // frames from a --wire-ts streamer, each stamped with its send time
+        const int sock = socks.front();
+        std::vector<MboMsg> frame;
+        FrameHeader hdr{};
+
+        while (!done) {
+            if (recv_all(sock, &hdr, sizeof(hdr), spin_stats) < sizeof(hdr)) break; // EOF
+            if (hdr.magic != kFrameMagic || hdr.count > kMaxFrameRecords) {
+                throw std::runtime_error("Bad frame header, is the streamer running with --wire-ts?");
+            }
+            frame.resize(hdr.count);
+            const std::size_t bytes = hdr.count * MSG_SIZE;
+            if (recv_all(sock, frame.data(), bytes, spin_stats) < bytes) break; // truncated
+            apply_frame(sock, hdr, frame, steady_now_ns());
+        }
+    } else {
+        const int sock = socks.front();
+        RecvBuffer rb;
+        rb.msgs.resize(opts.batch);
+
+        while (!done) {
+            std::size_t count = 0;
+            if (opts.batch <= 1) {
+                std::size_t n = recv_all(sock, rb.msgs.data(), MSG_SIZE, spin_stats);
+                if (n == 0) break;        // EOF
+                if (n < MSG_SIZE) break;  // truncated / error
+                count = 1;
+            } else {
+                count = recv_batch(sock, rb, spin_stats);
+                if (count == 0) break;    // EOF
+            }
+            if (metrics_server) on_received(sock, count);
+            process(std::span<const MboMsg>{rb.msgs.data(), count});
+        }
+    }
+
+    // a snapshot run still open at end of feed
+    if (const auto t0 = std::chrono::steady_clock::now(); book.flush_snapshot() && live) {
+        publish(last_ts, t0);
     }
 
     auto end = std::chrono::steady_clock::now();
     double total_s = std::chrono::duration<double>(end - start).count();
+    const RuntimeSample runtime_after = sample_runtime();
 
     if (!latencies_us.empty()) {
         std::sort(latencies_us.begin(), latencies_us.end());
@@ -218,8 +718,38 @@ void run_engine(OrderBook& book, const Options& opts) {
         std::cerr << "Latency (p95): " << p95 << " us\n";
         std::cerr << "Throughput    : " << throughput << " msg/s\n";
     }
+    print_runtime_stats(runtime_before, runtime_after, spin);
+
+    auto print_stage = [](const char* name, std::vector<std::uint64_t>& ns) {
+        if (ns.empty()) return;
+        std::sort(ns.begin(), ns.end());
+        auto at = [&](double p) { return ns[static_cast<std::size_t>(p * (ns.size() - 1))]; };
+        std::cerr << name << " (p50/p99): " << at(0.50) << " / " << at(0.99) << " ns\n";
+    };
+    print_stage("Snapshot build", snapshot_ns);
+    if (opts.signal_kernel != SignalKernel::Off) {
+        print_stage("Signals SoA copy", top_fill_ns);
+        std::string name = std::string("Signals kernel [") + to_string(opts.signal_kernel) + "]";
+        print_stage(name.c_str(), signals_ns);
+    }
+    if (arbiter) {
+        arbiter->print_stats(feed_names);
+    }
+    print_wire_stats(wire_by_rate);
+    book.print_load_stats();
+
+    // bars still open at EOF go out with the last snapshot
+    if (bars.enabled() && !whole_feed_json.empty()) {
+        bars.flush();
+        auto& last = whole_feed_json.back();
+        auto closed = bars_to_json(bars.take_closed());
+        if (!last.contains("bars")) last["bars"] = json::array();
+        for (auto& bar : closed) last["bars"].push_back(bar);
+    }
 
     write_snapshot_to_file(whole_feed_json, opts.output_path, std::nullopt);
 
-    ::close(sock);
+    for (int sock : socks) {
+        ::close(sock);
+    }
 }
@@ -1,32 +1,234 @@
 #include "order_book.hpp"
+#include "trace.hpp"
 #include <fstream>
 
 void OrderBook::on_event(const databento::MboMsg& ev) {
     using namespace std::chrono;
+    if (take_snapshot_record(ev, true)) return;
     auto start = Clock::now();
 
     total_orders++;
+    BookError error = BookError::None;
     try {
-        book_.Apply(ev);
+        MBO_TRACE_MSG_SPAN(trace::apply_name(static_cast<char>(ev.action)), ev);
+        error = std::visit([&ev](auto& book) { return book.Apply(ev); }, book_);
     }
     catch (const std::invalid_argument& ex) {
         // Log and ignore invalid events
         // std::cerr << "Warning: " << ex.what() << "\n";
-        error_count++;
+        error = reason_of(ex);
     }
     catch (const std::logic_error& ex) {
         // Log and ignore logic errors
         // std::cerr << "Warning: " << ex.what() << "\n";
-        error_count++;
+        error = reason_of(ex);
     }
+    const bool ok = error == BookError::None;
+    if (!ok) error_count++;
 
     auto end = Clock::now();
     auto dt  = duration_cast<nanoseconds>(end - start).count();
     latencies_ns_.push_back(static_cast<uint64_t>(dt));
+
+    if (metrics_) {
+        if (ok) metrics_->on_applied();
+        else metrics_->on_error(error);
+        update_book_metrics();
+        metrics_->record_latency_ns(static_cast<uint64_t>(dt));
+    }
+    check_first_valid();
+}
+
+void OrderBook::on_batch(std::span<const databento::MboMsg> batch) {
+    // Snapshot runs after a Clear are collected through on_event, the rest
+    // is applied in chunks
+    std::size_t start = 0;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (!after_clear_ && batch[i].action != databento::Action::Clear) continue;
+        apply_batch(batch.subspan(start, i - start));
+        on_event(batch[i]);
+        start = i + 1;
+    }
+    apply_batch(batch.subspan(start));
+}
+
+void OrderBook::apply_batch(std::span<const databento::MboMsg> batch) {
+    using namespace std::chrono;
+    if (batch.empty()) return;
+    note_first_record();
+    auto start = Clock::now();
+
+    total_orders += batch.size();
+    uint64_t errors = 0;
+    MBO_TRACE_SPAN("apply batch");
+    std::visit([&](auto& book) {
+        book.ApplyBatch(batch, [&](const databento::MboMsg&, BookError error) {
+            ++errors;
+            if (metrics_) metrics_->on_error(error);
+        });
+    }, book_);
+    error_count += errors;
+
+    auto end = Clock::now();
+    auto per_msg = static_cast<uint64_t>(duration_cast<nanoseconds>(end - start).count()) /
+                   batch.size();
+    latencies_ns_.insert(latencies_ns_.end(), batch.size(), per_msg);
+
+    if (metrics_) {
+        metrics_->on_applied(batch.size() - errors);
+        update_book_metrics();
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            metrics_->record_latency_ns(per_msg);
+        }
+    }
+    check_first_valid();
+}
+
+void OrderBook::catch_up(const databento::MboMsg& ev) {
+    MBO_TRACE_SPAN("catch up");
+    if (take_snapshot_record(ev, false)) return;
+    try {
+        std::visit([&ev](auto& book) { book.Apply(ev); }, book_);
+    }
+    catch (const std::logic_error&) {
+        // invalid_argument derives from logic_error
+    }
+    check_first_valid();
+}
+
+bool OrderBook::flush_snapshot() {
+    if (snapshot_buf_.empty()) return false;
+    load_snapshot();
+    return true;
+}
+
+bool OrderBook::take_snapshot_record(const databento::MboMsg& ev, bool counted) {
+    note_first_record();
+    if (after_clear_ && ev.action == databento::Action::Add && ev.flags.IsSnapshot()) {
+        snapshot_buf_.push_back(ev);
+        if (counted) ++snapshot_counted_;
+        // F_LAST closes the snapshot event, otherwise the next live record does
+        if (ev.flags.IsLast()) load_snapshot();
+        return true;
+    }
+    if (!snapshot_buf_.empty()) load_snapshot();
+    after_clear_ = ev.action == databento::Action::Clear;
+    if (after_clear_) clear_at_ = Clock::now();
+    return false;
+}
+
+void OrderBook::load_snapshot() {
+    using namespace std::chrono;
+    MBO_TRACE_SPAN("snapshot load");
+    const std::size_t n = snapshot_buf_.size();
+    // a run that started before --start: only its tail is counted (errors
+    // are reported on the buffered record itself)
+    const std::size_t counted = snapshot_counted_;
+    const databento::MboMsg* first_counted = snapshot_buf_.data() + (n - counted);
+    auto start = Clock::now();
+
+    uint64_t errors = 0;
+    std::visit([&](auto& book) {
+        book.LoadSnapshot(snapshot_buf_, [&](const databento::MboMsg& ev, BookError error) {
+            if (&ev < first_counted) return;
+            ++errors;
+            if (metrics_) {
+                metrics_->on_error(error);
+            }
+        });
+    }, book_);
+
+    auto end = Clock::now();
+    const auto load_ns = static_cast<uint64_t>(duration_cast<nanoseconds>(end - start).count());
+    snapshot_loads_.push_back(SnapshotLoad{
+        n, load_ns, static_cast<uint64_t>(duration_cast<nanoseconds>(end - clear_at_).count())});
+
+    if (counted) {
+        total_orders += counted;
+        error_count += errors;
+        latencies_ns_.insert(latencies_ns_.end(), counted, load_ns / n);
+        if (metrics_) {
+            metrics_->on_applied(counted - errors);
+            update_book_metrics();
+            for (std::size_t i = 0; i < counted; ++i) {
+                metrics_->record_latency_ns(load_ns / n);
+            }
+        }
+    }
+    snapshot_buf_.clear();
+    snapshot_counted_ = 0;
+    after_clear_ = false;
+    check_first_valid();
+}
+
+void OrderBook::note_first_record() {
+    if (!first_record_at_) first_record_at_ = Clock::now();
+}
+
+void OrderBook::check_first_valid() {
+    if (first_valid_ns_) return;
+    const bool valid = std::visit([](const auto& book) {
+        auto [bid_levels, ask_levels] = book.BidAskLevelCounts();
+        return bid_levels > 0 && ask_levels > 0;
+    }, book_);
+    if (!valid) return;
+    first_valid_ns_ = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - *first_record_at_).count());
+    if (metrics_) metrics_->set_time_to_valid_book_ns(*first_valid_ns_);
+}
+
+void OrderBook::update_book_metrics() {
+    std::visit([this](const auto& book) {
+        auto [bid_levels, ask_levels] = book.BidAskLevelCounts();
+        metrics_->set_book_depth(static_cast<uint32_t>(bid_levels),
+                                 static_cast<uint32_t>(ask_levels));
+        metrics_->set_live_orders(book.OrderCount());
+    }, book_);
+}
+
+void OrderBook::print_load_stats() const {
+    auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1'000'000.0; };
+    if (first_valid_ns_) {
+        std::cerr << "Time to first valid book: " << ms(*first_valid_ns_) << " ms\n";
+    } else {
+        std::cerr << "Book never had both sides\n";
+    }
+    for (const auto& load : snapshot_loads_) {
+        std::cerr << "Snapshot load: " << load.records << " records in " << ms(load.load_ns)
+                  << " ms, book valid " << ms(load.since_clear_ns) << " ms after Clear\n";
+    }
+}
+
+void OrderBook::top_of_book(TopOfBook& top, std::size_t levels) const {
+    levels = std::min(levels, TopOfBook::kMaxLevels);
+    std::visit([&](const auto& book) {
+        std::size_t n = 0;
+        book.ForEachBidLevel(levels, [&](const PriceLevel& level) {
+            top.bid_px[n] = static_cast<double>(level.price);
+            top.bid_sz[n] = level.size;
+            ++n;
+        });
+        // only the slots used last time can be non-zero
+        std::fill(top.bid_px + n, top.bid_px + std::max(n, top.bid_levels), 0.0);
+        std::fill(top.bid_sz + n, top.bid_sz + std::max(n, top.bid_levels), 0.0);
+        top.bid_levels = n;
+
+        n = 0;
+        book.ForEachAskLevel(levels, [&](const PriceLevel& level) {
+            top.ask_px[n] = static_cast<double>(level.price);
+            top.ask_sz[n] = level.size;
+            ++n;
+        });
+        std::fill(top.ask_px + n, top.ask_px + std::max(n, top.ask_levels), 0.0);
+        std::fill(top.ask_sz + n, top.ask_sz + std::max(n, top.ask_levels), 0.0);
+        top.ask_levels = n;
+    }, book_);
 }
 
-void OrderBook::write_snapshot_json(const std::string& path) const {
+void OrderBook::write_snapshot_json(const std::string& path, const json& extra) const {
+    MBO_TRACE_SPAN("serialize");
     auto j = snapshot(10);
+    j.update(extra);
     std::ofstream out(path);
     out << j.dump(2) << "\n";
     std::cerr << "Wrote order book snapshot to " << path << "\n";
@@ -0,0 +1,139 @@
+#include "runtime.hpp"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+std::uint64_t now_ns() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void warn(const char* what) {
+    std::cerr << "low-latency: " << what << " failed: " << std::strerror(errno) << "\n";
+}
+
+// Grow the heap once, advise hugepages, touch every page and give it back to
+// malloc without returning it to the kernel, so later book allocations land
+// on warm, THP-backed memory instead of faulting on the hot path.
+void prefault_heap(std::size_t bytes) {
+#ifdef __GLIBC__
+    mallopt(M_MMAP_MAX, 0);               // keep big blocks (hash buckets) on the heap too
+    mallopt(M_TRIM_THRESHOLD, -1);        // never give heap back to the kernel
+    mallopt(M_TOP_PAD, 64 * 1024 * 1024); // grow in large steps afterwards
+#endif
+    char* block = static_cast<char*>(std::malloc(bytes));
+    if (!block) {
+        warn("prefault malloc");
+        return;
+    }
+    constexpr std::size_t kHugePage = 2 * 1024 * 1024;
+    auto begin = (reinterpret_cast<std::uintptr_t>(block) + kHugePage - 1) & ~(kHugePage - 1);
+    auto end = (reinterpret_cast<std::uintptr_t>(block) + bytes) & ~(kHugePage - 1);
+    if (end > begin &&
+        ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) != 0) {
+        warn("madvise(MADV_HUGEPAGE)");
+    }
+    const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    for (std::size_t off = 0; off < bytes; off += page) {
+        static_cast<volatile char*>(block)[off] = 0;
+    }
+    std::free(block);
+}
+
+} // namespace
+
+void SpinStats::on_empty_poll() {
+    ++empty_polls;
+    const std::uint64_t now = now_ns();
+    if (last_poll_ns != 0) {
+        const std::uint64_t gap = now - last_poll_ns;
+        max_gap_ns = std::max(max_gap_ns, gap);
+        if (gap > kStallNs) ++stalls;
+    }
+    last_poll_ns = now;
+}
+
+RuntimeSample sample_runtime() {
+    rusage ru{};
+#ifdef RUSAGE_THREAD
+    ::getrusage(RUSAGE_THREAD, &ru);
+#else
+    ::getrusage(RUSAGE_SELF, &ru);
+#endif
+    return RuntimeSample{ru.ru_nvcsw, ru.ru_nivcsw, ru.ru_minflt, ru.ru_majflt};
+}
+
+void apply_low_latency_profile(const Options& opts) {
+    if (opts.cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(*opts.cpu, &set);
+        if (int rc = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); rc != 0) {
+            errno = rc;
+            warn("pthread_setaffinity_np");
+        }
+    }
+
+    if (opts.prefault_mb > 0) {
+        prefault_heap(opts.prefault_mb * 1024 * 1024);
+    }
+
+    // after the prefault so the warmed heap gets locked as well
+    if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        warn("mlockall");
+    }
+
+    std::cerr << "Low-latency profile: cpu=" << (opts.cpu ? std::to_string(*opts.cpu) : "any")
+              << " prefault=" << opts.prefault_mb << "MB\n";
+}
+
+void tune_socket_low_latency(int fd) {
+    int flags = ::fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        warn("fcntl(O_NONBLOCK)");
+    }
+    int one = 1;
+    if (::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0) {
+        warn("TCP_NODELAY");
+    }
+#ifdef SO_BUSY_POLL
+    int busy_poll_us = 50;
+    if (::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) != 0) {
+        warn("SO_BUSY_POLL");
+    }
+#endif
+}
+
+void print_runtime_stats(const RuntimeSample& before, const RuntimeSample& after,
+                         const std::optional<SpinStats>& spin) {
+    std::cerr << "== Runtime ==\n";
+    std::cerr << "Voluntary ctx switches  : " << after.voluntary_switches - before.voluntary_switches << "\n";
+    std::cerr << "Involuntary ctx switches: " << after.involuntary_switches - before.involuntary_switches << "\n";
+    std::cerr << "Page faults (minor/major): " << after.minor_faults - before.minor_faults
+              << " / " << after.major_faults - before.major_faults << "\n";
+    if (spin) {
+        std::cerr << "Empty polls             : " << spin->empty_polls << "\n";
+        std::cerr << "Poll gaps > " << SpinStats::kStallNs / 1000 << " us       : " << spin->stalls << "\n";
+        std::cerr << "Max poll gap            : " << static_cast<double>(spin->max_gap_ns) / 1000.0 << " us\n";
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include "config.hpp"
+
+// Counters for the spin-receive loop of the --low-latency profile
+struct SpinStats {
+    static constexpr std::uint64_t kStallNs = 10'000; // gap that means we were descheduled
+
+    std::uint64_t empty_polls = 0;
+    std::uint64_t stalls = 0;
+    std::uint64_t max_gap_ns = 0;
+    std::uint64_t last_poll_ns = 0;
+
+    void on_empty_poll();
+    void on_data() { last_poll_ns = 0; }
+};
+
+// Process / thread counters sampled before and after the run
+struct RuntimeSample {
+    long voluntary_switches = 0;   // blocking wakeups
+    long involuntary_switches = 0; // preemptions
+    long minor_faults = 0;
+    long major_faults = 0;
+};
+
+RuntimeSample sample_runtime();
+
+// Pins the calling thread, locks memory and pre-faults a hugepage-backed heap
+// region the book's allocations are then served from. Failures are reported
+// and skipped, the profile is best effort without privileges.
+void apply_low_latency_profile(const Options& opts);
+
+// Non-blocking, TCP_NODELAY and SO_BUSY_POLL where the kernel allows it
+void tune_socket_low_latency(int fd);
+
+void print_runtime_stats(const RuntimeSample& before, const RuntimeSample& after,
+                         const std::optional<SpinStats>& spin);
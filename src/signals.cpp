@@ -0,0 +1,145 @@
+#include "signals.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MBO_HAVE_AVX2_KERNEL 1
+#endif
+
+namespace {
+
+struct Sums {
+    double bid_sz = 0;
+    double ask_sz = 0;
+    double bid_notional = 0;
+    double ask_notional = 0;
+    double bid_depth = 0;
+    double ask_depth = 0;
+};
+
+// Levels to scan, rounded up to the SIMD width (slots past the end are zero)
+std::size_t padded_levels(const TopOfBook& top) {
+    return (std::max(top.bid_levels, top.ask_levels) + 3) & ~std::size_t{3};
+}
+
+Signals finish(const TopOfBook& top, const Sums& s) {
+    Signals out;
+    if (top.bid_levels == 0 || top.ask_levels == 0) return out;
+
+    const double bid = top.bid_px[0];
+    const double ask = top.ask_px[0];
+    const double bid_l1 = top.bid_sz[0];
+    const double ask_l1 = top.ask_sz[0];
+
+    out.valid = true;
+    out.microprice = bid_l1 + ask_l1 > 0
+        ? (bid * ask_l1 + ask * bid_l1) / (bid_l1 + ask_l1)
+        : (bid + ask) / 2;
+    out.weighted_mid = s.bid_sz > 0 && s.ask_sz > 0
+        ? (s.bid_notional / s.bid_sz + s.ask_notional / s.ask_sz) / 2
+        : (bid + ask) / 2;
+    out.imbalance_l1 = bid_l1 + ask_l1 > 0 ? (bid_l1 - ask_l1) / (bid_l1 + ask_l1) : 0;
+    out.imbalance = s.bid_sz + s.ask_sz > 0 ? (s.bid_sz - s.ask_sz) / (s.bid_sz + s.ask_sz) : 0;
+    out.bid_depth = s.bid_depth;
+    out.ask_depth = s.ask_depth;
+    return out;
+}
+
+#ifdef MBO_HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+double hsum(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+#endif
+
+} // namespace
+
+Signals compute_signals(SignalKernel kernel, const TopOfBook& top, std::int64_t depth_px) {
+    switch (kernel) {
+        case SignalKernel::Avx2:   return compute_signals_avx2(top, depth_px);
+        case SignalKernel::Scalar: return compute_signals_scalar(top, depth_px);
+        case SignalKernel::Off:    break;
+    }
+    return Signals{};
+}
+
+Signals compute_signals_scalar(const TopOfBook& top, std::int64_t depth_px) {
+    const double bid_limit = top.bid_px[0] - static_cast<double>(depth_px);
+    const double ask_limit = top.ask_px[0] + static_cast<double>(depth_px);
+
+    Sums s;
+    const std::size_t n = padded_levels(top);
+    for (std::size_t i = 0; i < n; ++i) {
+        s.bid_sz += top.bid_sz[i];
+        s.ask_sz += top.ask_sz[i];
+        s.bid_notional += top.bid_px[i] * top.bid_sz[i];
+        s.ask_notional += top.ask_px[i] * top.ask_sz[i];
+        if (top.bid_px[i] >= bid_limit) s.bid_depth += top.bid_sz[i];
+        if (top.ask_px[i] <= ask_limit) s.ask_depth += top.ask_sz[i];
+    }
+    return finish(top, s);
+}
+
+#ifdef MBO_HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+Signals compute_signals_avx2(const TopOfBook& top, std::int64_t depth_px) {
+    const __m256d bid_limit = _mm256_set1_pd(top.bid_px[0] - static_cast<double>(depth_px));
+    const __m256d ask_limit = _mm256_set1_pd(top.ask_px[0] + static_cast<double>(depth_px));
+
+    __m256d bid_sz = _mm256_setzero_pd();
+    __m256d ask_sz = _mm256_setzero_pd();
+    __m256d bid_notional = _mm256_setzero_pd();
+    __m256d ask_notional = _mm256_setzero_pd();
+    __m256d bid_depth = _mm256_setzero_pd();
+    __m256d ask_depth = _mm256_setzero_pd();
+
+    const std::size_t n = padded_levels(top);
+    for (std::size_t i = 0; i < n; i += 4) {
+        const __m256d bp = _mm256_load_pd(top.bid_px + i);
+        const __m256d bs = _mm256_load_pd(top.bid_sz + i);
+        const __m256d ap = _mm256_load_pd(top.ask_px + i);
+        const __m256d as = _mm256_load_pd(top.ask_sz + i);
+
+        bid_sz = _mm256_add_pd(bid_sz, bs);
+        ask_sz = _mm256_add_pd(ask_sz, as);
+        bid_notional = _mm256_add_pd(bid_notional, _mm256_mul_pd(bp, bs));
+        ask_notional = _mm256_add_pd(ask_notional, _mm256_mul_pd(ap, as));
+        bid_depth = _mm256_add_pd(bid_depth,
+                                  _mm256_and_pd(_mm256_cmp_pd(bp, bid_limit, _CMP_GE_OQ), bs));
+        ask_depth = _mm256_add_pd(ask_depth,
+                                  _mm256_and_pd(_mm256_cmp_pd(ap, ask_limit, _CMP_LE_OQ), as));
+    }
+
+    Sums s;
+    s.bid_sz = hsum(bid_sz);
+    s.ask_sz = hsum(ask_sz);
+    s.bid_notional = hsum(bid_notional);
+    s.ask_notional = hsum(ask_notional);
+    s.bid_depth = hsum(bid_depth);
+    s.ask_depth = hsum(ask_depth);
+    // finish() and the rest of the engine are SSE code, leaving the upper
+    // halves dirty makes every one of their instructions pay a transition
+    _mm256_zeroupper();
+    return finish(top, s);
+}
+#else
+Signals compute_signals_avx2(const TopOfBook& top, std::int64_t depth_px) {
+    return compute_signals_scalar(top, depth_px);
+}
+#endif
+
+nlohmann::json signals_to_json(const Signals& s) {
+    if (!s.valid) return nullptr;
+    return {
+        {"microprice", s.microprice},
+        {"weighted_mid", s.weighted_mid},
+        {"imbalance_l1", s.imbalance_l1},
+        {"imbalance", s.imbalance},
+        {"bid_depth", s.bid_depth},
+        {"ask_depth", s.ask_depth},
+    };
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <nlohmann/json.hpp>
+
+#include "config.hpp"
+
+// Book-derived signals computed right after Apply over a structure-of-arrays
+// copy of the top N levels. Prices stay in raw DBN units (1e-9).
+struct TopOfBook {
+    static constexpr std::size_t kMaxLevels = kMaxSignalLevels;
+
+    // unused slots are zero, so they drop out of every sum
+    alignas(32) double bid_px[kMaxLevels]{};
+    alignas(32) double bid_sz[kMaxLevels]{};
+    alignas(32) double ask_px[kMaxLevels]{};
+    alignas(32) double ask_sz[kMaxLevels]{};
+    std::size_t bid_levels = 0;
+    std::size_t ask_levels = 0;
+};
+
+struct Signals {
+    bool valid = false;         // both sides present
+    double microprice = 0;      // L1 size-weighted towards the thinner side
+    double weighted_mid = 0;    // mean of the per-side VWAPs over N levels
+    double imbalance_l1 = 0;    // (bid - ask) / (bid + ask) size at L1
+    double imbalance = 0;       // same over N levels
+    double bid_depth = 0;       // bid size within depth_px of the best bid
+    double ask_depth = 0;       // ask size within depth_px of the best ask
+};
+
+Signals compute_signals(SignalKernel kernel, const TopOfBook& top, std::int64_t depth_px);
+Signals compute_signals_scalar(const TopOfBook& top, std::int64_t depth_px);
+Signals compute_signals_avx2(const TopOfBook& top, std::int64_t depth_px);
+
+nlohmann::json signals_to_json(const Signals& s);
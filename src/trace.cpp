@@ -0,0 +1,189 @@
+#include "trace.hpp"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+#ifdef MBO_TRACE
+namespace {
+
+constexpr std::size_t kRingEvents = 1 << 20; // per thread, power of two
+
+struct Event {
+    const char* name;
+    std::uint64_t begin;
+    std::uint64_t end;
+    MsgArgs args;
+};
+
+struct Ring {
+    std::vector<Event> events = std::vector<Event>(kRingEvents);
+    std::atomic<std::uint64_t> head{0}; // events ever written
+    long tid = ::syscall(SYS_gettid);
+};
+
+struct State {
+    std::atomic<bool> enabled{false};
+    std::string path;
+    std::uint64_t tick0 = 0;
+    double ns_per_tick = 1.0;
+
+    // rings stay alive after their thread exits so the exit dump sees them
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+std::atomic<bool> dump_requested{false};
+static_assert(std::atomic<bool>::is_always_lock_free);
+
+void on_sigusr1(int) {
+    dump_requested.store(true, std::memory_order_relaxed);
+}
+
+Ring& local_ring() {
+    thread_local Ring* ring = [] {
+        auto owned = std::make_unique<Ring>();
+        Ring* r = owned.get();
+        std::lock_guard lock{state().mutex};
+        state().rings.push_back(std::move(owned));
+        return r;
+    }();
+    return *ring;
+}
+
+// ticks per ns from a short spin against steady_clock
+void calibrate(State& s) {
+    using Clock = std::chrono::steady_clock;
+    const auto t0 = Clock::now();
+    const std::uint64_t c0 = now_ticks();
+    while (Clock::now() - t0 < std::chrono::milliseconds(20)) {
+    }
+    const auto t1 = Clock::now();
+    const std::uint64_t c1 = now_ticks();
+    const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    s.ns_per_tick = c1 > c0 ? ns / static_cast<double>(c1 - c0) : 1.0;
+    s.tick0 = c0;
+}
+
+} // namespace
+
+void record(const char* name, std::uint64_t begin, std::uint64_t end, const MsgArgs& args) {
+    if (!state().enabled.load(std::memory_order_relaxed)) return;
+    Ring& ring = local_ring();
+    const std::uint64_t i = ring.head.load(std::memory_order_relaxed);
+    ring.events[i & (kRingEvents - 1)] = Event{name, begin, end, args};
+    ring.head.store(i + 1, std::memory_order_release);
+}
+
+void enable(std::string path) {
+    State& s = state();
+    s.path = std::move(path);
+    calibrate(s);
+    std::signal(SIGUSR1, on_sigusr1);
+    s.enabled.store(true, std::memory_order_relaxed);
+    std::cerr << "Tracing to " << s.path << " (" << 1.0 / s.ns_per_tick
+              << " ticks/ns, SIGUSR1 dumps)\n";
+}
+
+void dump() {
+    State& s = state();
+    if (!s.enabled.load(std::memory_order_relaxed)) return;
+
+    std::ofstream out(s.path);
+    if (out.fail()) {
+        std::cerr << "Failed to open trace file: " << s.path << "\n";
+        return;
+    }
+    const long pid = ::getpid();
+    auto to_us = [&](std::uint64_t ticks) {
+        return static_cast<double>(ticks - s.tick0) * s.ns_per_tick / 1000.0;
+    };
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    bool first = true;
+    std::size_t written = 0;
+
+    std::lock_guard lock{s.mutex};
+    for (const auto& ring : s.rings) {
+        // other threads may still write; their oldest events can be torn,
+        // the dumping thread's own ring is exact
+        const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+        const std::uint64_t count = std::min<std::uint64_t>(head, kRingEvents);
+        for (std::uint64_t i = head - count; i < head; ++i) {
+            const Event& e = ring->events[i & (kRingEvents - 1)];
+            if (e.begin < s.tick0) continue;
+            out << (first ? "" : ",\n") << "{\"name\":\"" << e.name
+                << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << ring->tid
+                << ",\"ts\":" << to_us(e.begin)
+                << ",\"dur\":" << to_us(e.end) - to_us(e.begin);
+            if (e.args.action) {
+                const char action = std::isalpha(static_cast<unsigned char>(e.args.action))
+                                        ? e.args.action : '?';
+                out << ",\"args\":{\"order_id\":" << e.args.order_id
+                    << ",\"ts_recv\":" << e.args.ts_recv
+                    << ",\"sequence\":" << e.args.sequence
+                    << ",\"action\":\"" << action << "\"}";
+            }
+            out << "}";
+            first = false;
+            ++written;
+        }
+    }
+    out << "\n]}\n";
+    std::cerr << "Wrote " << written << " trace events to " << s.path << "\n";
+}
+
+void poll() {
+    if (dump_requested.load(std::memory_order_relaxed)) {
+        dump_requested.store(false, std::memory_order_relaxed);
+        dump();
+    }
+}
+
+#else
+
+void record(const char*, std::uint64_t, std::uint64_t, const MsgArgs&) {}
+
+void enable(std::string) {
+    std::cerr << "Built without MBO_TRACE, --trace ignored\n";
+}
+
+void dump() {}
+
+void poll() {}
+
+#endif
+
+const char* apply_name(char action) {
+    switch (action) {
+        case 'A': return "apply A";
+        case 'C': return "apply C";
+        case 'M': return "apply M";
+        case 'R': return "apply R";
+        case 'T': return "apply T";
+        case 'F': return "apply F";
+        case 'N': return "apply N";
+    }
+    return "apply ?";
+}
+
+} // namespace trace
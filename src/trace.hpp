@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#if defined(MBO_TRACE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Hot-path spans in Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+// Only compiled in with -DMBO_TRACE=ON, otherwise MBO_TRACE_SPAN expands to
+// nothing. Spans are stamped with rdtsc and converted to time with a ratio
+// calibrated against steady_clock once, at trace::enable(). Every thread
+// writes to its own ring (single writer, no locks, oldest spans overwritten).
+namespace trace {
+
+inline std::uint64_t now_ticks() {
+#if defined(MBO_TRACE) && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Record a span applied, written as the event's "args"
+struct MsgArgs {
+    std::uint64_t order_id = 0;
+    std::uint64_t ts_recv = 0;
+    std::uint32_t sequence = 0;
+    char action = 0; // 0: no args
+};
+
+void record(const char* name, std::uint64_t begin, std::uint64_t end, const MsgArgs& args = {});
+
+// `name` must outlive the trace (string literals)
+class Span {
+public:
+    explicit Span(const char* name) : name_(name), begin_(now_ticks()) {}
+    Span(const char* name, const MsgArgs& args) : name_(name), args_(args), begin_(now_ticks()) {}
+    ~Span() { record(name_, begin_, now_ticks(), args_); }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* name_;
+    MsgArgs args_;
+    std::uint64_t begin_;
+};
+
+// Starts recording; dump() writes to `path`. SIGUSR1 requests a dump that
+// the traced loop picks up at its next poll().
+void enable(std::string path);
+
+// Writes every thread's ring. Called once at exit and after SIGUSR1.
+void dump();
+
+// Dumps if SIGUSR1 arrived since the last call; one relaxed load otherwise
+void poll();
+
+// "apply A", "apply C", ... for per-action spans
+const char* apply_name(char action);
+
+} // namespace trace
+
+#ifdef MBO_TRACE
+#define MBO_TRACE_CAT2(a, b) a##b
+#define MBO_TRACE_CAT(a, b) MBO_TRACE_CAT2(a, b)
+#define MBO_TRACE_SPAN(name) ::trace::Span MBO_TRACE_CAT(trace_span_, __LINE__){name}
+// span tagged with the MboMsg `msg` (order_id, ts_recv, sequence, action)
+#define MBO_TRACE_MSG_SPAN(name, msg)                                                  \
+    ::trace::Span MBO_TRACE_CAT(trace_span_, __LINE__){                                \
+        name, ::trace::MsgArgs{(msg).order_id,                                         \
+                               static_cast<std::uint64_t>(                             \
+                                   (msg).ts_recv.time_since_epoch().count()),          \
+                               (msg).sequence, static_cast<char>((msg).action)}}
+#define MBO_TRACE_POLL() ::trace::poll()
+#else
+#define MBO_TRACE_SPAN(name) ((void)0)
+#define MBO_TRACE_MSG_SPAN(name, msg) ((void)0)
+#define MBO_TRACE_POLL() ((void)0)
+#endif